@@ -0,0 +1,42 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+void* ScratchArena::allocate(size_t bytes, size_t alignment)
+{
+	while (_currentBlock < _blocks.size())
+	{
+		Block& block = _blocks[_currentBlock];
+		const size_t start = (_offset + alignment - 1) & ~(alignment - 1);
+		if (start + bytes <= block._size)
+		{
+			_offset = start + bytes;
+			return block._memory.get() + start;
+		}
+
+		// Does not fit in what is left of this block, later blocks might be large enough
+		++_currentBlock;
+		_offset = 0;
+	}
+
+	// Only happens until the arena has grown to what a path needs
+	const size_t size = std::max(BLOCK_SIZE, bytes + alignment);
+	_blocks.push_back(Block{ std::make_unique<std::byte[]>(size), size });
+	_currentBlock = _blocks.size() - 1;
+
+	// new[] memory is aligned for any fundamental type, larger alignments are not needed here
+	_offset = bytes;
+	return _blocks.back()._memory.get();
+}
+
+void ScratchArena::reset()
+{
+	_currentBlock = 0;
+	_offset = 0;
+}
+
+ScratchArena& ScratchArena::local()
+{
+	thread_local ScratchArena arena;
+	return arena;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+// Bump allocator for the short lived objects of one sample or one photon path.
+// Memory comes from large blocks that are kept between resets, so once they
+// are warmed up tracing a path never has to call the system allocator
+class ScratchArena
+{
+public:
+	ScratchArena() = default;
+	ScratchArena(const ScratchArena&) = delete;
+
+	void* allocate(size_t bytes, size_t alignment);
+	// Everything allocated since the last reset is gone after this
+	void reset();
+
+	// Every thread has its own arena
+	static ScratchArena& local();
+
+private:
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> _memory;
+		size_t _size;
+	};
+
+	std::vector<Block> _blocks;
+	size_t _currentBlock = 0;
+	size_t _offset = 0;
+
+	static constexpr size_t BLOCK_SIZE = 256 * 1024;
+};
+
+// Hands out memory from a ScratchArena, deallocation does nothing
+// as everything is released together when the arena is reset
+template<typename T>
+struct ArenaAllocator
+{
+	using value_type = T;
+
+	template<typename U>
+	struct rebind { using other = ArenaAllocator<U>; };
+
+	ArenaAllocator(ScratchArena& arena) : _arena{ &arena } {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : _arena{ other._arena } {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return _arena == other._arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return _arena != other._arena; }
+
+	ScratchArena* _arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -1,5 +1,8 @@
 #include "basic_types.hpp"
-#include "glm/gtx/string_cast.hpp"
+
+#include <cmath>
+
+#include "diagnostics.hpp"
 
 Color safeDivide(const Color& num, const Color& den)
 {
@@ -9,7 +12,7 @@ Color safeDivide(const Color& num, const Color& den)
 
 	if (std::isnan(r) || std::isnan(g) || std::isnan(b) ||
 		std::isinf(r) || std::isinf(g) || std::isinf(b))
-		std::cout << glm::to_string(num) << '/' << glm::to_string(den) << "\n = (" << r << ", " << g << ", " << b << ") oh nooo\n";
+		Diagnostics::count(Diagnostic::INVALID_DIVISION);
 	
 	return Color(r, g, b);
 }
@@ -14,16 +14,7 @@ typedef glm::vec3 Direction;
 typedef glm::vec<3, double> Color;
 using Radiance = Color; //For clarity
 
-class Ray;
-
-class Pixel
-{
-public:
-	void addRay(std::shared_ptr<Ray> ray) { _ray = ray; }
-	Color _color{ };
-private:
-	std::shared_ptr<Ray> _ray; // The ray that goes through the pixel
-};
+struct Ray;
 
 struct IntersectionData
 {
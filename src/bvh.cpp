@@ -0,0 +1,896 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <chrono>
+
+#include "scenegeometry.hpp"
+#include "threadpool.hpp"
+
+namespace
+{
+	void extendByTriangle(Bounds& bounds, const Triangle& triangle)
+	{
+		for (int i = 0; i < 3; ++i)
+			bounds.extend(glm::vec3{ triangle.getVertex(i) });
+	}
+
+	// Slightly more than 1, keeps rounding in the slab test from missing hits on box faces
+	constexpr float SLAB_PADDING = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+	// Candidate split planes per axis at most
+	constexpr int MAX_BINS = 64;
+	// Ranges this large are bounded and binned in parallel
+	constexpr size_t PARALLEL_BINNING_SIZE = 16 * 1024;
+	// Subtrees are made small enough for several of them per thread, but not smaller than this
+	constexpr size_t MIN_SUBTREE_SIZE = 1024;
+
+	struct Bin
+	{
+		Bounds _bounds;
+		size_t _count = 0;
+	};
+	// The bins of the three axes one after the other
+	using Bins = std::vector<Bin>;
+
+	// Calls task(i) for every i in [0, count), on the pool if there is one
+	void forEach(ThreadPool* pool, size_t count, const std::function<void(size_t)>& task)
+	{
+		if (pool)
+		{
+			pool->parallelFor(count, task);
+			return;
+		}
+		for (size_t i = 0; i < count; ++i)
+			task(i);
+	}
+
+	// Splits [0, count) into a few chunks per thread and calls task(begin, end, chunk) for each
+	template<typename Task>
+	void forEachChunk(ThreadPool* pool, size_t count, Task&& task)
+	{
+		const size_t numChunks = pool ? std::min(count, 4 * pool->size()) : 1;
+		forEach(pool, numChunks, [&](size_t chunk)
+		{
+			task(count * chunk / numChunks, count * (chunk + 1) / numChunks, chunk);
+		});
+	}
+
+	// The same with a result per chunk, merged into one at the end
+	template<typename Result, typename Task, typename Merge>
+	Result forEachChunk(ThreadPool* pool, size_t count, const Result& initial, Task&& task, Merge&& merge)
+	{
+		std::vector<Result> results(pool ? std::min(count, 4 * pool->size()) : 1, initial);
+		forEachChunk(pool, count, [&](size_t begin, size_t end, size_t chunk) { task(begin, end, results[chunk]); });
+
+		for (size_t i = 1; i < results.size(); ++i)
+			merge(results[0], results[i]);
+		return std::move(results[0]);
+	}
+
+	// The bounds of what extend adds for every primitive in [begin, end), in parallel for large ranges
+	template<typename Context, typename Extend>
+	Bounds rangeBounds(const Context& context, size_t begin, size_t end, Extend&& extend)
+	{
+		ThreadPool* pool = end - begin >= PARALLEL_BINNING_SIZE ? context._pool : nullptr;
+		return forEachChunk(pool, end - begin, Bounds{}, [&](size_t chunkBegin, size_t chunkEnd, Bounds& bounds)
+		{
+			for (size_t i = begin + chunkBegin; i < begin + chunkEnd; ++i)
+				extend(context._primitives[i], bounds);
+		}, [](Bounds& bounds, const Bounds& other) { bounds.extend(other); });
+	}
+}
+
+void Bounds::extend(const glm::vec3& point)
+{
+	_min = glm::min(_min, point);
+	_max = glm::max(_max, point);
+}
+
+void Bounds::extend(const Bounds& other)
+{
+	_min = glm::min(_min, other._min);
+	_max = glm::max(_max, other._max);
+}
+
+float Bounds::surfaceArea() const
+{
+	const glm::vec3 size = _max - _min;
+	if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+		return 0.0f;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+std::optional<IntersectionData> primitiveIntersection(const PrimitiveRef& primitive, const Ray& ray,
+	const SceneGeometry& geometry)
+{
+	switch (primitive._kind)
+	{
+	case PrimitiveRef::TRIANGLE_OBJ:
+		return geometry._sceneTris[primitive._index].rayIntersection(ray);
+	case PrimitiveRef::TETRAHEDRON:
+		return geometry._tetrahedrons[primitive._index].rayIntersection(ray);
+	case PrimitiveRef::SPHERE:
+		return geometry._spheres[primitive._index].rayIntersection(ray);
+	case PrimitiveRef::CEILING_LIGHT:
+		return geometry._ceilingLights[primitive._index].rayIntersection(ray);
+	}
+	return {};
+}
+
+bool primitiveBlocks(const PrimitiveRef& primitive, const Ray& ray, const SceneGeometry& geometry)
+{
+	auto blocks = [&](float t) { return t >= ray._tMin && t < ray._tMax; };
+	switch (primitive._kind)
+	{
+	case PrimitiveRef::TRIANGLE_OBJ:
+		return blocks(geometry._sceneTris[primitive._index].getTriangle().rayIntersection(ray));
+	case PrimitiveRef::TETRAHEDRON:
+		for (const Triangle& triangle : geometry._tetrahedrons[primitive._index].getTriangles())
+			if (blocks(triangle.rayIntersection(ray)))
+				return true;
+		return false;
+	case PrimitiveRef::SPHERE:
+		return blocks(geometry._spheres[primitive._index].hitDistance(ray));
+	case PrimitiveRef::CEILING_LIGHT:
+		for (const TriangleObj& triangle : geometry._ceilingLights[primitive._index].getTriangles())
+			if (blocks(triangle.getTriangle().rayIntersection(ray)))
+				return true;
+		return false;
+	}
+	return false;
+}
+
+const SceneObject* primitiveObject(const PrimitiveRef& primitive, const SceneGeometry& geometry)
+{
+	switch (primitive._kind)
+	{
+	case PrimitiveRef::TRIANGLE_OBJ:
+		return &geometry._sceneTris[primitive._index];
+	case PrimitiveRef::TETRAHEDRON:
+		return &geometry._tetrahedrons[primitive._index];
+	case PrimitiveRef::SPHERE:
+		return &geometry._spheres[primitive._index];
+	case PrimitiveRef::CEILING_LIGHT:
+		return &geometry._ceilingLights[primitive._index];
+	}
+	return nullptr;
+}
+
+Bounds primitiveBounds(const PrimitiveRef& primitive, const SceneGeometry& geometry)
+{
+	Bounds bounds;
+	switch (primitive._kind)
+	{
+	case PrimitiveRef::TRIANGLE_OBJ:
+		extendByTriangle(bounds, geometry._sceneTris[primitive._index].getTriangle());
+		break;
+	case PrimitiveRef::TETRAHEDRON:
+		for (const Triangle& triangle : geometry._tetrahedrons[primitive._index].getTriangles())
+			extendByTriangle(bounds, triangle);
+		break;
+	case PrimitiveRef::SPHERE:
+	{
+		const Sphere& sphere = geometry._spheres[primitive._index];
+		const glm::vec3 center{ sphere.getPosition() };
+		bounds.extend(center - glm::vec3{ sphere.getRadius() });
+		bounds.extend(center + glm::vec3{ sphere.getRadius() });
+		break;
+	}
+	case PrimitiveRef::CEILING_LIGHT:
+		for (const TriangleObj& triangle : geometry._ceilingLights[primitive._index].getTriangles())
+			extendByTriangle(bounds, triangle.getTriangle());
+		break;
+	}
+	return bounds;
+}
+
+Bvh::Bvh()
+{
+	setTriangleKernel(detectTriangleKernel());
+}
+
+void Bvh::setTriangleKernel(TriangleKernel kernel)
+{
+	_kernel = triangleKernelSupported(kernel) ? kernel : TriangleKernel::SCALAR;
+	_testPackets = trianglePacketTest(_kernel);
+}
+
+void Bvh::build(const SceneGeometry& geometry, const BvhBuildSettings& settings)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<PrimitiveRef> refs;
+	refs.reserve(geometry._sceneTris.size() + geometry._tetrahedrons.size() +
+		geometry._spheres.size() + geometry._ceilingLights.size());
+	auto add = [&](PrimitiveRef::Kind kind, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			refs.push_back(PrimitiveRef{ kind, 0, static_cast<uint32_t>(i) });
+	};
+	add(PrimitiveRef::TRIANGLE_OBJ, geometry._sceneTris.size());
+	add(PrimitiveRef::TETRAHEDRON, geometry._tetrahedrons.size());
+	add(PrimitiveRef::SPHERE, geometry._spheres.size());
+	add(PrimitiveRef::CEILING_LIGHT, geometry._ceilingLights.size());
+
+	const size_t numThreads = std::max<size_t>(1, std::min(
+		settings._numThreads == 0 ? ThreadPool::hardwareThreads() : settings._numThreads,
+		refs.size() / MIN_SUBTREE_SIZE));
+	std::unique_ptr<ThreadPool> pool;
+	if (numThreads > 1)
+		pool = std::make_unique<ThreadPool>(numThreads);
+
+	std::vector<BuildPrimitive> primitives(refs.size());
+	forEachChunk(pool.get(), refs.size(), [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			PrimitiveRef primitive = refs[i];
+			const unsigned surfaceType = primitiveObject(primitive, geometry)->getBRDF().getSurfaceType();
+			if (surfaceType != BRDF::TRANSPARENT && surfaceType != BRDF::LIGHT)
+				primitive._flags |= PrimitiveRef::CASTS_SHADOW;
+			if (primitive._kind != PrimitiveRef::CEILING_LIGHT)
+				primitive._flags |= PrimitiveRef::SCATTERS_PHOTONS;
+
+			const Bounds bounds = primitiveBounds(primitive, geometry);
+			primitives[i] = BuildPrimitive{ bounds, bounds.center(), primitive };
+		}
+	});
+
+	_nodes.clear();
+	_leaves.clear();
+	_primitives.clear();
+	_packets.clear();
+	_buildStats = BvhBuildStats{};
+	_buildStats._numThreads = numThreads;
+	if (primitives.empty())
+		return;
+
+	BuildContext context{ primitives, geometry, std::clamp(settings._numBins, 2, MAX_BINS), pool.get() };
+	std::vector<TopNode> topNodes;
+	std::vector<Subtree> subtrees;
+	const size_t subtreeSize = numThreads == 1 ? primitives.size() :
+		std::max(MIN_SUBTREE_SIZE, primitives.size() / (8 * numThreads));
+	buildTop(context, 0, primitives.size(), 0, subtreeSize, topNodes, subtrees);
+
+	// Stealing balances subtrees of different cost, the binning above is not thread safe
+	context._pool = nullptr;
+	forEach(pool.get(), subtrees.size(), [&](size_t i)
+	{
+		Subtree& subtree = subtrees[i];
+		subtree._output._nodes.reserve(2 * (subtree._end - subtree._begin) - 1);
+		subtree._output._primitives.reserve(subtree._end - subtree._begin);
+		buildRecursive(context, subtree._output, subtree._begin, subtree._end, subtree._depth);
+	});
+
+	flatten(topNodes, subtrees, pool.get());
+
+	_buildStats._seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	_buildStats._sahCost = sahCost();
+	_buildStats._numSubtrees = subtrees.size();
+}
+
+uint32_t Bvh::buildTop(BuildContext& context, size_t begin, size_t end, int depth, size_t subtreeSize,
+	std::vector<TopNode>& topNodes, std::vector<Subtree>& subtrees) const
+{
+	const uint32_t index = static_cast<uint32_t>(topNodes.size());
+	topNodes.push_back(TopNode{ Bounds{}, 0, { 0, 0 }, -1 });
+
+	uint8_t axis = 0;
+	size_t middle = end;
+	if (end - begin > subtreeSize)
+	{
+		const Bounds bounds = rangeBounds(context, begin, end,
+			[](const BuildPrimitive& primitive, Bounds& bounds) { bounds.extend(primitive._bounds); });
+		middle = partition(context, begin, end, bounds, depth, axis);
+		topNodes[index]._bounds = bounds;
+	}
+
+	// Small enough, or a leaf, which the subtree builder makes all the same
+	if (middle == end)
+	{
+		topNodes[index]._subtree = static_cast<int>(subtrees.size());
+		subtrees.push_back(Subtree{ begin, end, depth, {}, 0, 0, 0 });
+		return index;
+	}
+
+	// Depth first, the subtrees come out in the order of their primitives
+	topNodes[index]._axis = axis;
+	const uint32_t first = buildTop(context, begin, middle, depth + 1, subtreeSize, topNodes, subtrees);
+	const uint32_t second = buildTop(context, middle, end, depth + 1, subtreeSize, topNodes, subtrees);
+	topNodes[index]._children[0] = first;
+	topNodes[index]._children[1] = second;
+	return index;
+}
+
+void Bvh::flatten(const std::vector<TopNode>& topNodes, std::vector<Subtree>& subtrees, ThreadPool* pool)
+{
+	if (topNodes.size() == 1)
+	{
+		BuildOutput& output = subtrees[0]._output;
+		_nodes = std::move(output._nodes);
+		_leaves = std::move(output._leaves);
+		_primitives = std::move(output._primitives);
+		_packets = std::move(output._packets);
+		return;
+	}
+
+	// Where everything goes: the subtrees keep the order they were made in, each
+	// top node is followed by its first child and everything below that
+	std::vector<uint32_t> treeSize(topNodes.size());
+	for (size_t i = topNodes.size(); i-- > 0;)
+	{
+		const TopNode& node = topNodes[i];
+		treeSize[i] = node._subtree >= 0 ? static_cast<uint32_t>(subtrees[node._subtree]._output._nodes.size()) :
+			1 + treeSize[node._children[0]] + treeSize[node._children[1]];
+	}
+
+	std::vector<uint32_t> position(topNodes.size());
+	for (size_t i = 0; i < topNodes.size(); ++i)
+	{
+		const TopNode& node = topNodes[i];
+		if (node._subtree >= 0)
+		{
+			subtrees[node._subtree]._firstNode = position[i];
+			continue;
+		}
+		position[node._children[0]] = position[i] + 1;
+		position[node._children[1]] = position[i] + 1 + treeSize[node._children[0]];
+	}
+
+	size_t numLeaves = 0;
+	size_t numPackets = 0;
+	for (Subtree& subtree : subtrees)
+	{
+		subtree._firstLeaf = static_cast<uint32_t>(numLeaves);
+		subtree._firstPacket = static_cast<uint32_t>(numPackets);
+		numLeaves += subtree._output._leaves.size();
+		numPackets += subtree._output._packets.size();
+	}
+
+	_nodes.resize(treeSize[0]);
+	_leaves.resize(numLeaves);
+	_primitives.resize(subtrees.back()._end);
+	_packets.resize(numPackets);
+
+	forEach(pool, subtrees.size(), [&](size_t i)
+	{
+		Subtree& subtree = subtrees[i];
+		const BuildOutput& output = subtree._output;
+		const uint32_t firstPrimitive = static_cast<uint32_t>(subtree._begin);
+
+		for (size_t j = 0; j < output._nodes.size(); ++j)
+		{
+			Node node = output._nodes[j];
+			node._offset += node._count == 0 ? subtree._firstNode : subtree._firstLeaf;
+			_nodes[subtree._firstNode + j] = node;
+		}
+		for (size_t j = 0; j < output._leaves.size(); ++j)
+		{
+			Leaf leaf = output._leaves[j];
+			leaf._firstPrimitive += firstPrimitive;
+			leaf._firstPacket += subtree._firstPacket;
+			_leaves[subtree._firstLeaf + j] = leaf;
+		}
+		std::copy(output._primitives.begin(), output._primitives.end(), _primitives.begin() + subtree._begin);
+		for (size_t j = 0; j < output._packets.size(); ++j)
+		{
+			TrianglePacket packet = output._packets[j];
+			for (uint32_t& primitive : packet._primitive)
+				primitive += firstPrimitive;
+			_packets[subtree._firstPacket + j] = packet;
+		}
+		subtree._output = BuildOutput{};
+	});
+
+	// Bottom up, the flags need the children
+	for (size_t i = topNodes.size(); i-- > 0;)
+	{
+		const TopNode& node = topNodes[i];
+		if (node._subtree >= 0)
+			continue;
+
+		const uint32_t first = position[node._children[0]];
+		const uint32_t second = position[node._children[1]];
+		_nodes[position[i]] = Node{ node._bounds._min, second, node._bounds._max, 0, node._axis,
+			static_cast<uint8_t>(_nodes[first]._flags | _nodes[second]._flags) };
+	}
+}
+
+float Bvh::sahCost() const
+{
+	auto area = [](const Node& node) { return Bounds{ node._min, node._max }.surfaceArea(); };
+	const float rootArea = area(_nodes[0]);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	// The packets the leaves actually hold, a tetrahedron fills four lanes and a light two,
+	// and one test for every sphere
+	double cost = 0.0;
+	for (const Node& node : _nodes)
+	{
+		if (node._count == 0)
+		{
+			cost += area(node) * TRAVERSAL_COST;
+			continue;
+		}
+
+		const Leaf& leaf = _leaves[node._offset];
+		cost += area(node) * (leaf._numPackets + (node._count - leaf._numTriangulated));
+	}
+	return static_cast<float>(cost / rootArea);
+}
+
+uint32_t Bvh::buildRecursive(BuildContext& context, BuildOutput& output, size_t begin, size_t end, int depth)
+{
+	Bounds bounds;
+	for (size_t i = begin; i < end; ++i)
+		bounds.extend(context._primitives[i]._bounds);
+
+	uint8_t axis;
+	const size_t middle = partition(context, begin, end, bounds, depth, axis);
+	if (middle == end)
+		return makeLeaf(context, output, begin, end, bounds);
+
+	const uint32_t index = static_cast<uint32_t>(output._nodes.size());
+	output._nodes.push_back(Node{ bounds._min, 0, bounds._max, 0, axis, 0 });
+
+	// Depth first, the first child ends up right after its parent
+	const uint32_t first = buildRecursive(context, output, begin, middle, depth + 1);
+	const uint32_t second = buildRecursive(context, output, middle, end, depth + 1);
+	output._nodes[index]._offset = second;
+	output._nodes[index]._flags = output._nodes[first]._flags | output._nodes[second]._flags;
+	return index;
+}
+
+size_t Bvh::partition(BuildContext& context, size_t begin, size_t end, const Bounds& bounds, int depth,
+	uint8_t& axis)
+{
+	std::vector<BuildPrimitive>& primitives = context._primitives;
+	const int numBins = context._numBins;
+	const size_t count = end - begin;
+	if (count == 1)
+		return end;
+
+	const Bounds centroidBounds = rangeBounds(context, begin, end,
+		[](const BuildPrimitive& primitive, Bounds& bounds) { bounds.extend(primitive._centroid); });
+
+	const glm::vec3 extent = centroidBounds._max - centroidBounds._min;
+	axis = extent.x >= extent.y ? (extent.x >= extent.z ? 0 : 2) : (extent.y >= extent.z ? 1 : 2);
+
+	auto halve = [&]()
+	{
+		const size_t middle = begin + count / 2;
+		std::nth_element(primitives.begin() + begin, primitives.begin() + middle, primitives.begin() + end,
+			[a = axis](const BuildPrimitive& x, const BuildPrimitive& y) { return x._centroid[a] < y._centroid[a]; });
+		return middle;
+	};
+
+	// All centroids in one point, or too deep to trust the heuristic: halve by the longest axis
+	if (extent[axis] <= 0.0f || depth >= MAX_SAH_DEPTH)
+	{
+		if (count <= MAX_LEAF_SIZE && extent[axis] <= 0.0f)
+			return end;
+
+		return halve();
+	}
+
+	auto binIndex = [&](const glm::vec3& centroid, int binAxis)
+	{
+		const float offset = (centroid[binAxis] - centroidBounds._min[binAxis]) / extent[binAxis];
+		return std::min(static_cast<int>(offset * numBins), numBins - 1);
+	};
+
+	// The bins of all three axes in one pass over the primitives, per chunk when
+	// there are enough of them to go parallel
+	const Bins bins = forEachChunk(count >= PARALLEL_BINNING_SIZE ? context._pool : nullptr, count, Bins(3 * numBins),
+		[&](size_t chunkBegin, size_t chunkEnd, Bins& chunkBins)
+	{
+		for (size_t i = begin + chunkBegin; i < begin + chunkEnd; ++i)
+		{
+			for (int binAxis = 0; binAxis < 3; ++binAxis)
+			{
+				if (extent[binAxis] <= 0.0f)
+					continue;
+
+				Bin& bin = chunkBins[binAxis * numBins + binIndex(primitives[i]._centroid, binAxis)];
+				bin._bounds.extend(primitives[i]._bounds);
+				++bin._count;
+			}
+		}
+	}, [](Bins& bins, const Bins& chunkBins)
+	{
+		for (size_t i = 0; i < bins.size(); ++i)
+		{
+			bins[i]._bounds.extend(chunkBins[i]._bounds);
+			bins[i]._count += chunkBins[i]._count;
+		}
+	});
+
+	// The cost of a split after bin i is the cost of testing the packets on each
+	// side, weighed by how likely a ray through the node is to pass through that side
+	float bestCost = std::numeric_limits<float>::infinity();
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int binAxis = 0; binAxis < 3; ++binAxis)
+	{
+		if (extent[binAxis] <= 0.0f)
+			continue;
+
+		const Bin* axisBins = &bins[binAxis * numBins];
+
+		// Sweep from the right to get the area and count above every split, then from the left
+		std::array<float, MAX_BINS - 1> rightCost;
+		Bounds right;
+		size_t rightCount = 0;
+		for (int i = numBins - 1; i > 0; --i)
+		{
+			right.extend(axisBins[i]._bounds);
+			rightCount += axisBins[i]._count;
+			rightCost[i - 1] = leafCost(rightCount) * right.surfaceArea();
+		}
+
+		Bounds left;
+		size_t leftCount = 0;
+		for (int i = 0; i < numBins - 1; ++i)
+		{
+			left.extend(axisBins[i]._bounds);
+			leftCount += axisBins[i]._count;
+			if (leftCount == 0 || leftCount == count)
+				continue;
+
+			const float cost = leafCost(leftCount) * left.surfaceArea() + rightCost[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = binAxis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	const float area = bounds.surfaceArea();
+	const float splitCost = area > 0.0f ? TRAVERSAL_COST + bestCost / area : 0.0f;
+	if (bestAxis < 0 || (count <= MAX_LEAF_SIZE && splitCost >= leafCost(count)))
+	{
+		if (count <= MAX_LEAF_SIZE)
+			return end;
+
+		// Every centroid fell in the same bin, fall back to halving
+		return halve();
+	}
+
+	axis = static_cast<uint8_t>(bestAxis);
+	const auto middle = std::partition(primitives.begin() + begin, primitives.begin() + end,
+		[&](const BuildPrimitive& primitive) { return binIndex(primitive._centroid, bestAxis) <= bestSplit; });
+	return static_cast<size_t>(middle - primitives.begin());
+}
+
+uint32_t Bvh::makeLeaf(BuildContext& context, BuildOutput& output, size_t begin, size_t end, const Bounds& bounds)
+{
+	std::vector<BuildPrimitive>& primitives = context._primitives;
+	const SceneGeometry& geometry = context._geometry;
+
+	// The primitives made of triangles first, only those go in packets
+	const auto spheres = std::stable_partition(primitives.begin() + begin, primitives.begin() + end,
+		[](const BuildPrimitive& primitive) { return primitive._primitive._kind != PrimitiveRef::SPHERE; });
+
+	Leaf leaf{ static_cast<uint32_t>(output._primitives.size()), static_cast<uint32_t>(output._packets.size()), 0,
+		static_cast<uint16_t>(spheres - (primitives.begin() + begin)) };
+	uint8_t flags = 0;
+	int lane = TrianglePacket::WIDTH;
+	auto addTriangle = [&](const Triangle& triangle, const PrimitiveRef& primitive)
+	{
+		if (lane == TrianglePacket::WIDTH)
+		{
+			output._packets.emplace_back();
+			++leaf._numPackets;
+			lane = 0;
+		}
+		output._packets.back().set(lane++, triangle, static_cast<uint32_t>(output._primitives.size()),
+			(primitive._flags & PrimitiveRef::CASTS_SHADOW) != 0);
+	};
+
+	for (size_t i = begin; i < end; ++i)
+	{
+		const PrimitiveRef& primitive = primitives[i]._primitive;
+		switch (primitive._kind)
+		{
+		case PrimitiveRef::TRIANGLE_OBJ:
+			addTriangle(geometry._sceneTris[primitive._index].getTriangle(), primitive);
+			break;
+		case PrimitiveRef::TETRAHEDRON:
+			for (const Triangle& triangle : geometry._tetrahedrons[primitive._index].getTriangles())
+				addTriangle(triangle, primitive);
+			break;
+		case PrimitiveRef::CEILING_LIGHT:
+			for (const TriangleObj& triangle : geometry._ceilingLights[primitive._index].getTriangles())
+				addTriangle(triangle.getTriangle(), primitive);
+			break;
+		case PrimitiveRef::SPHERE:
+			break;
+		}
+		output._primitives.push_back(primitive);
+		flags |= primitive._flags;
+	}
+
+	const uint32_t index = static_cast<uint32_t>(output._nodes.size());
+	output._nodes.push_back(Node{ bounds._min, static_cast<uint32_t>(output._leaves.size()), bounds._max,
+		static_cast<uint16_t>(end - begin), 0, flags });
+	output._leaves.push_back(leaf);
+	return index;
+}
+
+bool Bvh::Node::intersects(const Ray& ray, float tMax) const
+{
+	float tNear;
+	return intersects(ray, tMax, tNear);
+}
+
+bool Bvh::Node::intersects(const Ray& ray, float tMax, float& tNear) const
+{
+	tNear = ray._tMin;
+	float tFar = tMax;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float t0 = (_min[axis] - ray._origin[axis]) * ray._invDirection[axis];
+		float t1 = (_max[axis] - ray._origin[axis]) * ray._invDirection[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		t1 *= SLAB_PADDING;
+
+		// Written so a NaN from a ray in the plane of a face changes nothing
+		tNear = t0 > tNear ? t0 : tNear;
+		tFar = t1 < tFar ? t1 : tFar;
+		if (tNear > tFar)
+			return false;
+	}
+	return true;
+}
+
+template<typename LeafFunction>
+void Bvh::traverse(const Ray& ray, const float& tMax, uint8_t requiredFlags, LeafFunction&& visitLeaf) const
+{
+	if (_nodes.empty())
+		return;
+
+	const bool directionIsNegative[3] = {
+		ray._invDirection.x < 0.0f, ray._invDirection.y < 0.0f, ray._invDirection.z < 0.0f };
+
+	uint32_t stack[STACK_SIZE];
+	int stackSize = 0;
+	uint32_t current = 0;
+	while (true)
+	{
+		const Node& node = _nodes[current];
+		if ((node._flags & requiredFlags) == requiredFlags && node.intersects(ray, tMax))
+		{
+			if (node._count == 0)
+			{
+				// The near child first, the far one waits on the stack
+				if (directionIsNegative[node._axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node._offset;
+				}
+				else
+				{
+					stack[stackSize++] = node._offset;
+					current = current + 1;
+				}
+				continue;
+			}
+
+			if (visitLeaf(_leaves[node._offset], node._count))
+				return;
+		}
+
+		if (stackSize == 0)
+			return;
+		current = stack[--stackSize];
+	}
+}
+
+std::optional<IntersectionSurface> Bvh::closestHit(const Ray& ray, const SceneGeometry& geometry,
+	uint8_t requiredFlags) const
+{
+	// Only the distance and the primitive while searching, the rest is worked out for the winner
+	float minT = ray._tMax;
+	uint32_t closest = std::numeric_limits<uint32_t>::max();
+	auto consider = [&](float t, uint32_t primitive)
+	{
+		if ((_primitives[primitive]._flags & requiredFlags) != requiredFlags)
+			return;
+
+		if (t < minT || (t == minT && closest != std::numeric_limits<uint32_t>::max() &&
+			_primitives[primitive].before(_primitives[closest])))
+		{
+			minT = t;
+			closest = primitive;
+		}
+	};
+
+	traverse(ray, minT, requiredFlags, [&](const Leaf& leaf, uint16_t count)
+	{
+		alignas(32) float t[TrianglePacket::WIDTH];
+		for (uint32_t i = leaf._firstPacket; i < leaf._firstPacket + leaf._numPackets; ++i)
+		{
+			const TrianglePacket& packet = _packets[i];
+			const uint32_t hits = _testPackets(ray, packet, minT, t);
+			if (hits == 0)
+				continue;
+
+			for (int lane = 0; lane < TrianglePacket::WIDTH; ++lane)
+				if (hits & (1u << lane))
+					consider(t[lane], packet._primitive[lane]);
+		}
+
+		for (uint32_t i = leaf._firstPrimitive + leaf._numTriangulated; i < leaf._firstPrimitive + count; ++i)
+		{
+			const float t = geometry._spheres[_primitives[i]._index].hitDistance(ray);
+			if (t >= 0.0f)
+				consider(t, i);
+		}
+		return false;
+	});
+
+	if (closest == std::numeric_limits<uint32_t>::max())
+		return {};
+
+	const PrimitiveRef& primitive = _primitives[closest];
+	const auto hit = primitiveIntersection(primitive, ray, geometry);
+	// The object may decide differently than its triangles did on their own, a
+	// tetrahedron ignores hits beyond 1e10 for one
+	if (!hit || hit->_t != minT)
+		return closestHitByObject(ray, geometry, requiredFlags);
+
+	return IntersectionSurface{ *hit, primitiveObject(primitive, geometry) };
+}
+
+std::optional<IntersectionSurface> Bvh::closestHitByObject(const Ray& ray, const SceneGeometry& geometry,
+	uint8_t requiredFlags) const
+{
+	std::optional<IntersectionSurface> closest{};
+	float minT = ray._tMax;
+	PrimitiveRef closestPrimitive{};
+
+	traverse(ray, minT, requiredFlags, [&](const Leaf& leaf, uint16_t count)
+	{
+		for (uint32_t i = leaf._firstPrimitive; i < leaf._firstPrimitive + count; ++i)
+		{
+			const PrimitiveRef& primitive = _primitives[i];
+			if ((primitive._flags & requiredFlags) != requiredFlags)
+				continue;
+
+			const auto hit = primitiveIntersection(primitive, ray, geometry);
+			if (!hit)
+				continue;
+
+			if (hit->_t < minT || (closest && hit->_t == minT && primitive.before(closestPrimitive)))
+			{
+				closest = IntersectionSurface{ *hit, primitiveObject(primitive, geometry) };
+				closestPrimitive = primitive;
+				minT = hit->_t;
+			}
+		}
+		return false;
+	});
+
+	return closest;
+}
+
+bool Bvh::occluded(const Ray& ray, const SceneGeometry& geometry) const
+{
+	// The kernels keep hits at tMax, shadow rays end just before their target
+	const float tMax = std::nextafter(ray._tMax, 0.0f);
+	bool blocked = false;
+
+	traverse(ray, ray._tMax, PrimitiveRef::CASTS_SHADOW, [&](const Leaf& leaf, uint16_t count)
+	{
+		alignas(32) float t[TrianglePacket::WIDTH];
+		for (uint32_t i = leaf._firstPacket; i < leaf._firstPacket + leaf._numPackets; ++i)
+		{
+			const TrianglePacket& packet = _packets[i];
+			if (packet._castsShadow != 0 && (_testPackets(ray, packet, tMax, t) & packet._castsShadow) != 0)
+				return blocked = true;
+		}
+
+		for (uint32_t i = leaf._firstPrimitive + leaf._numTriangulated; i < leaf._firstPrimitive + count; ++i)
+		{
+			const PrimitiveRef& primitive = _primitives[i];
+			if ((primitive._flags & PrimitiveRef::CASTS_SHADOW) && primitiveBlocks(primitive, ray, geometry))
+				return blocked = true;
+		}
+		return false;
+	});
+
+	return blocked;
+}
+
+void Bvh::hitsInOrder(const Ray& ray, float tMin, const SceneGeometry& geometry, uint8_t requiredFlags,
+	ArenaVector<float>& distances) const
+{
+	if (_nodes.empty())
+		return;
+
+	// Both heaps nearest first, in the arena of distances
+	using NodeEntry = std::pair<float, uint32_t>;
+	auto fartherNode = [](const NodeEntry& a, const NodeEntry& b) { return a.first > b.first; };
+	ArenaVector<NodeEntry> nodes{ distances.get_allocator() };
+	ArenaVector<float> pending{ distances.get_allocator() };
+
+	auto pushNode = [&](uint32_t index)
+	{
+		const Node& node = _nodes[index];
+		float tNear;
+		if ((node._flags & requiredFlags) == requiredFlags && node.intersects(ray, ray._tMax, tNear))
+		{
+			nodes.emplace_back(tNear, index);
+			std::push_heap(nodes.begin(), nodes.end(), fartherNode);
+		}
+	};
+	auto pushHit = [&](float t, uint32_t primitive)
+	{
+		if (t > tMin && (_primitives[primitive]._flags & requiredFlags) == requiredFlags)
+		{
+			pending.push_back(t);
+			std::push_heap(pending.begin(), pending.end(), std::greater<float>{});
+		}
+	};
+	auto emitUpTo = [&](float limit)
+	{
+		while (!pending.empty() && pending.front() <= limit)
+		{
+			distances.push_back(pending.front());
+			std::pop_heap(pending.begin(), pending.end(), std::greater<float>{});
+			pending.pop_back();
+		}
+	};
+
+	pushNode(0);
+	alignas(32) float t[TrianglePacket::WIDTH];
+	while (!nodes.empty())
+	{
+		std::pop_heap(nodes.begin(), nodes.end(), fartherNode);
+		const NodeEntry entry = nodes.back();
+		nodes.pop_back();
+
+		// Everything still to be visited starts beyond this node
+		emitUpTo(entry.first);
+
+		const Node& node = _nodes[entry.second];
+		if (node._count == 0)
+		{
+			pushNode(entry.second + 1);
+			pushNode(node._offset);
+			continue;
+		}
+
+		const Leaf& leaf = _leaves[node._offset];
+		for (uint32_t i = leaf._firstPacket; i < leaf._firstPacket + leaf._numPackets; ++i)
+		{
+			const TrianglePacket& packet = _packets[i];
+			const uint32_t hits = _testPackets(ray, packet, ray._tMax, t);
+			if (hits == 0)
+				continue;
+
+			for (int lane = 0; lane < TrianglePacket::WIDTH; ++lane)
+				if (hits & (1u << lane))
+					pushHit(t[lane], packet._primitive[lane]);
+		}
+
+		for (uint32_t i = leaf._firstPrimitive + leaf._numTriangulated; i < leaf._firstPrimitive + node._count; ++i)
+		{
+			float sphereHits[2];
+			const int numHits = geometry._spheres[_primitives[i]._index].hitDistances(ray, sphereHits);
+			for (int j = 0; j < numHits; ++j)
+				if (sphereHits[j] <= ray._tMax)
+					pushHit(sphereHits[j], i);
+		}
+	}
+
+	emitUpTo(std::numeric_limits<float>::infinity());
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <limits>
+#include <cstdint>
+
+#include "basic_types.hpp"
+#include "ray.hpp"
+#include "shapes.hpp"
+#include "trianglepacket.hpp"
+
+class SceneGeometry;
+class ThreadPool;
+
+// An axis aligned box, empty until something is added to it
+struct Bounds
+{
+	glm::vec3 _min{ std::numeric_limits<float>::infinity() };
+	glm::vec3 _max{ -std::numeric_limits<float>::infinity() };
+
+	void extend(const glm::vec3& point);
+	void extend(const Bounds& other);
+	glm::vec3 center() const { return 0.5f * (_min + _max); }
+	// 0 for empty boxes
+	float surfaceArea() const;
+};
+
+// One object of a SceneGeometry, whatever its kind, by its index in the list of that kind
+struct PrimitiveRef
+{
+	enum Kind : uint8_t
+	{
+		TRIANGLE_OBJ,
+		TETRAHEDRON,
+		SPHERE,
+		CEILING_LIGHT
+	};
+
+	// What the primitive takes part in, set when the BVH is built
+	enum Flags : uint8_t
+	{
+		// Blocks shadow rays, everything but transparent objects and lights
+		CASTS_SHADOW = 1,
+		// Photons stop at it, everything but the ceiling lights they are emitted from
+		SCATTERS_PHOTONS = 2
+	};
+
+	Kind _kind;
+	uint8_t _flags;
+	uint32_t _index;
+
+	// The order the linear search used to visit the objects in, equally close hits
+	// go to the primitive that comes first
+	bool before(const PrimitiveRef& other) const
+	{
+		return _kind != other._kind ? _kind < other._kind : _index < other._index;
+	}
+};
+
+// The closest hit of ray with the primitive, if there is one
+std::optional<IntersectionData> primitiveIntersection(const PrimitiveRef& primitive, const Ray& ray,
+	const SceneGeometry& geometry);
+// Whether ray hits the primitive before its end, without working out where
+bool primitiveBlocks(const PrimitiveRef& primitive, const Ray& ray, const SceneGeometry& geometry);
+const SceneObject* primitiveObject(const PrimitiveRef& primitive, const SceneGeometry& geometry);
+Bounds primitiveBounds(const PrimitiveRef& primitive, const SceneGeometry& geometry);
+
+// How a Bvh is built. More candidate split planes find trees that are cheaper to
+// trace but take longer to build
+struct BvhBuildSettings
+{
+	int _numBins = 16;
+	// 0 uses every hardware thread
+	size_t _numThreads = 0;
+};
+
+// What the last build took and produced. The SAH cost is the expected cost of a
+// ray through the root in node visits, packet tests and sphere tests, lower is better
+struct BvhBuildStats
+{
+	double _seconds = 0.0;
+	float _sahCost = 0.0f;
+	size_t _numThreads = 0;
+	size_t _numSubtrees = 0;
+};
+
+// Bounding volume hierarchy over all objects of a SceneGeometry. It is built top
+// down, every split is the best of a few candidate planes by the surface area
+// heuristic, and stored as a flat array in depth first order: the first child of
+// an interior node comes right after it, only the second one needs an index.
+// Traversal visits the child on the near side of the split first, so the hits
+// found early cull the far side. The triangles of the objects in a leaf are kept
+// in TrianglePackets and tested with the widest kernel the CPU supports, only
+// spheres are tested one at a time. The objects are referred to by index, the
+// hierarchy has to be rebuilt whenever the object lists of the geometry change.
+// The build runs on a thread pool: the top levels are split one at a time with
+// the primitives binned in parallel, the subtrees below them are built as
+// independent tasks and copied into place in parallel at the end. The tree is
+// the same whatever the number of threads.
+class Bvh
+{
+public:
+	Bvh();
+
+	void build(const SceneGeometry& geometry, const BvhBuildSettings& settings = {});
+	const BvhBuildStats& buildStats() const { return _buildStats; }
+
+	// The same hit the linear search over all objects finds, among the primitives
+	// with all of requiredFlags
+	std::optional<IntersectionSurface> closestHit(const Ray& ray, const SceneGeometry& geometry,
+		uint8_t requiredFlags = 0) const;
+	// Whether anything that casts shadows is hit before the end of ray, stops at the first one
+	bool occluded(const Ray& ray, const SceneGeometry& geometry) const;
+	// Appends the distance to every hit further away than tMin to distances, nearest
+	// first, where rays entering and leaving objects both count. Nodes are visited in
+	// the order the ray enters them and a hit is passed on as soon as no node left
+	// can hold a closer one, so the hits never have to be sorted all together
+	void hitsInOrder(const Ray& ray, float tMin, const SceneGeometry& geometry, uint8_t requiredFlags,
+		ArenaVector<float>& distances) const;
+
+	// detectTriangleKernel picks the kernel, this is for comparing them
+	void setTriangleKernel(TriangleKernel kernel);
+	TriangleKernel triangleKernel() const { return _kernel; }
+
+	size_t numNodes() const { return _nodes.size(); }
+	size_t numPrimitives() const { return _primitives.size(); }
+	size_t numPackets() const { return _packets.size(); }
+
+private:
+	struct Node
+	{
+		glm::vec3 _min;
+		// The second child of an interior node, the Leaf of a leaf
+		uint32_t _offset;
+		glm::vec3 _max;
+		// The number of primitives in a leaf, 0 for interior nodes
+		uint16_t _count;
+		// The first child of an interior node is on the low side of this axis
+		uint8_t _axis;
+		// The PrimitiveRef flags of any primitive below, subtrees without shadow casters are skipped
+		uint8_t _flags;
+
+		// Whether ray enters the box before tMax
+		bool intersects(const Ray& ray, float tMax) const;
+		// The same, and where it enters
+		bool intersects(const Ray& ray, float tMax, float& tNear) const;
+	};
+
+	struct Leaf
+	{
+		// The primitives are next to each other in _primitives, the ones made of
+		// triangles first. Their triangles are in the packets
+		uint32_t _firstPrimitive;
+		uint32_t _firstPacket;
+		uint16_t _numPackets;
+		uint16_t _numTriangulated;
+	};
+
+	struct BuildPrimitive
+	{
+		Bounds _bounds;
+		glm::vec3 _centroid;
+		PrimitiveRef _primitive;
+	};
+
+	// The flat arrays of a whole tree, or of one subtree while it is built on its own
+	struct BuildOutput
+	{
+		std::vector<Node> _nodes;
+		std::vector<Leaf> _leaves;
+		std::vector<PrimitiveRef> _primitives;
+		std::vector<TrianglePacket> _packets;
+	};
+
+	// A node above the subtrees, either split in two or the root of subtree _subtree
+	struct TopNode
+	{
+		Bounds _bounds;
+		uint8_t _axis;
+		uint32_t _children[2];
+		int _subtree;
+	};
+
+	struct Subtree
+	{
+		size_t _begin;
+		size_t _end;
+		int _depth;
+		BuildOutput _output;
+		// Where the output goes in the whole tree
+		uint32_t _firstNode;
+		uint32_t _firstLeaf;
+		uint32_t _firstPacket;
+	};
+
+	// Everything the parts of one build share
+	struct BuildContext
+	{
+		std::vector<BuildPrimitive>& _primitives;
+		const SceneGeometry& _geometry;
+		int _numBins;
+		ThreadPool* _pool;
+	};
+
+	std::vector<Node> _nodes;
+	std::vector<Leaf> _leaves;
+	std::vector<PrimitiveRef> _primitives;
+	std::vector<TrianglePacket> _packets;
+
+	TriangleKernel _kernel;
+	TrianglePacketTest _testPackets;
+	BvhBuildStats _buildStats;
+
+	// Leaves with more primitives are split even if the heuristic advises against it
+	static constexpr size_t MAX_LEAF_SIZE = TrianglePacket::WIDTH;
+	// The cost of visiting a node relative to testing one packet
+	static constexpr float TRAVERSAL_COST = 1.0f;
+	// Deeper down the primitives are split in halves, which bounds the traversal stack
+	static constexpr int MAX_SAH_DEPTH = 64;
+	static constexpr int STACK_SIZE = 128;
+
+	// Calls visitLeaf(leaf, count) for every leaf ray enters before tMax, near ones first,
+	// until it returns true. tMax may shrink on the way. Subtrees without any of
+	// requiredFlags are skipped
+	template<typename LeafFunction>
+	void traverse(const Ray& ray, const float& tMax, uint8_t requiredFlags, LeafFunction&& visitLeaf) const;
+	// The closest hit found by testing the objects one by one instead of in packets
+	std::optional<IntersectionSurface> closestHitByObject(const Ray& ray, const SceneGeometry& geometry,
+		uint8_t requiredFlags) const;
+
+	// Splits primitives [begin, end) down to ranges of at most subtreeSize, which are
+	// left to subtree tasks. Returns the index of the node in topNodes
+	uint32_t buildTop(BuildContext& context, size_t begin, size_t end, int depth, size_t subtreeSize,
+		std::vector<TopNode>& topNodes, std::vector<Subtree>& subtrees) const;
+	// Appends the subtree over primitives [begin, end) to output, returns its root
+	static uint32_t buildRecursive(BuildContext& context, BuildOutput& output, size_t begin, size_t end, int depth);
+	// Splits [begin, end) in two non empty halves, returns where the second starts
+	// and the axis, or end if a leaf is better
+	static size_t partition(BuildContext& context, size_t begin, size_t end, const Bounds& bounds, int depth,
+		uint8_t& axis);
+	static uint32_t makeLeaf(BuildContext& context, BuildOutput& output, size_t begin, size_t end,
+		const Bounds& bounds);
+	// Writes the top nodes and copies the subtrees into place
+	void flatten(const std::vector<TopNode>& topNodes, std::vector<Subtree>& subtrees, ThreadPool* pool);
+	float sahCost() const;
+	// What testing a leaf with count primitives costs, in packets, while building. It takes
+	// every primitive for one triangle, sahCost counts the packets that were made
+	static float leafCost(size_t count) { return static_cast<float>((count + TrianglePacket::WIDTH - 1) / TrianglePacket::WIDTH); }
+};
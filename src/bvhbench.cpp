@@ -0,0 +1,189 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "scenegeometry.hpp"
+#include "raycastingfunctions.hpp"
+#include "threadpool.hpp"
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	// Inside the room, away from the walls
+	glm::vec3 randomPointInRoom(std::mt19937& generator)
+	{
+		std::uniform_real_distribution<float> x{ 0.5f, 9.5f }, y{ -4.5f, 4.5f }, z{ -4.5f, 4.5f };
+		return glm::vec3{ x(generator), y(generator), z(generator) };
+	}
+
+	glm::vec3 randomDirection(std::mt19937& generator)
+	{
+		std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+		const float z = 1.0f - 2.0f * unit(generator);
+		const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		const float phi = TWO_PI * unit(generator);
+		return glm::vec3{ r * std::cos(phi), r * std::sin(phi), z };
+	}
+
+	// Small triangles spread through the room, smaller the more there are so the
+	// rays still get some way
+	void addRandomTriangles(SceneGeometry& geometry, size_t count, std::mt19937& generator)
+	{
+		const float size = 2.0f / std::cbrt(static_cast<float>(std::max<size_t>(count, 1)));
+		geometry._sceneTris.reserve(geometry._sceneTris.size() + count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 center = randomPointInRoom(generator);
+			geometry._sceneTris.emplace_back(
+				BRDF{ BRDF::DIFFUSE },
+				Vertex{ center + size * randomDirection(generator), 1.0f },
+				Vertex{ center + size * randomDirection(generator), 1.0f },
+				Vertex{ center + size * randomDirection(generator), 1.0f },
+				Color{ 0.8, 0.8, 0.8 });
+		}
+	}
+
+	std::vector<Ray> randomRays(size_t count, std::mt19937& generator)
+	{
+		std::vector<Ray> rays;
+		rays.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+			rays.push_back(Ray::fromDirection(Vertex{ randomPointInRoom(generator), 1.0f }, randomDirection(generator)));
+		return rays;
+	}
+}
+
+// Closest hit rays per second on one thread, through the BVH with every leaf test
+// kernel the CPU runs and by testing every object, and shadow rays per second
+// through the BVH occlusion query, for the Cornell box with more and more random
+// triangles added to it
+int main(int argc, char* argv[])
+{
+	size_t largest = 1'000'000;
+	if (argc > 1)
+		largest = std::stoul(argv[1]);
+
+	std::mt19937 generator{ 1234 };
+
+	// Every leaf test kernel this CPU runs, the last one is the one the renderer picks
+	std::vector<TriangleKernel> kernels;
+	for (TriangleKernel kernel : { TriangleKernel::SCALAR, TriangleKernel::SSE, TriangleKernel::AVX2 })
+		if (triangleKernelSupported(kernel))
+			kernels.push_back(kernel);
+
+	std::cout << std::setw(12) << "objects" << std::setw(12) << "nodes" << std::setw(12) << "build ms" << std::setw(10) << "SAH cost";
+	for (TriangleKernel kernel : kernels)
+		std::cout << std::setw(16) << std::string{ triangleKernelName(kernel) } + " Mrays/s";
+	std::cout << std::setw(21) << "shadow closest/any" << std::setw(17) << "linear Mrays/s" << std::setw(12) << "mismatches" << std::setw(9) << "hit %" << "\n";
+
+	// The largest scene is kept for comparing build settings
+	std::unique_ptr<SceneGeometry> geometryPointer;
+	std::vector<Ray> rays;
+	for (size_t added = 0; added <= largest; added = added == 0 ? 1000 : added * 10)
+	{
+		// The scene announces itself, which would break up the table
+		std::streambuf* output = std::cout.rdbuf(nullptr);
+		geometryPointer = std::make_unique<SceneGeometry>();
+		std::cout.rdbuf(output);
+		std::cout.clear();
+		SceneGeometry& geometry = *geometryPointer;
+		addRandomTriangles(geometry, added, generator);
+		geometry.buildBvh();
+
+		rays = randomRays(200'000, generator);
+		// Counting the hits keeps the loops from being optimized away
+		size_t hits = 0;
+		std::vector<double> kernelSeconds;
+		for (TriangleKernel kernel : kernels)
+		{
+			geometry._bvh.setTriangleKernel(kernel);
+			const auto bvhStart = Clock::now();
+			for (const Ray& ray : rays)
+				hits += rayIntersection(ray, geometry).has_value();
+			kernelSeconds.push_back(std::chrono::duration<double>(Clock::now() - bvhStart).count());
+		}
+
+		// Shadow rays between two points in the room, stopping at the first blocker
+		std::vector<Ray> segments;
+		segments.reserve(rays.size());
+		for (size_t i = 0; i < rays.size(); ++i)
+			segments.push_back(Ray::segment(Vertex{ randomPointInRoom(generator), 1.0f }, Vertex{ randomPointInRoom(generator), 1.0f }));
+		const auto segmentStart = Clock::now();
+		for (const Ray& segment : segments)
+			hits += rayIntersection(segment, geometry).has_value();
+		const double segmentSeconds = std::chrono::duration<double>(Clock::now() - segmentStart).count();
+		const auto occlusionStart = Clock::now();
+		for (const Ray& segment : segments)
+			hits += geometry._bvh.occluded(segment, geometry);
+		const double occlusionSeconds = std::chrono::duration<double>(Clock::now() - occlusionStart).count();
+
+		// Keeps the linear search at about the same amount of work for every size
+		const size_t numObjects = geometry._bvh.numPrimitives();
+		const size_t linearRays = std::min(rays.size(), std::max<size_t>(200, 20'000'000 / numObjects));
+		const auto linearStart = Clock::now();
+		for (size_t i = 0; i < linearRays; ++i)
+			hits += rayIntersectionLinear(rays[i], geometry).has_value();
+		const double linearSeconds = std::chrono::duration<double>(Clock::now() - linearStart).count();
+
+		// Every kernel has to find the same object at the same distance
+		size_t mismatches = 0;
+		for (TriangleKernel kernel : kernels)
+		{
+			geometry._bvh.setTriangleKernel(kernel);
+			for (size_t i = 0; i < linearRays; ++i)
+			{
+				const auto expected = rayIntersectionLinear(rays[i], geometry);
+				const auto hit = rayIntersection(rays[i], geometry);
+				if (expected.has_value() != hit.has_value() ||
+					(hit && (expected->intersectionObject != hit->intersectionObject ||
+						expected->intersectionData._t != hit->intersectionData._t)))
+					++mismatches;
+			}
+		}
+
+		std::cout << std::setw(12) << numObjects << std::setw(12) << geometry._bvh.numNodes()
+			<< std::setw(12) << std::fixed << std::setprecision(1) << geometry._bvh.buildStats()._seconds * 1e3
+			<< std::setw(10) << geometry._bvh.buildStats()._sahCost << std::setprecision(4);
+		for (double seconds : kernelSeconds)
+			std::cout << std::setw(16) << rays.size() / seconds / 1e6;
+		std::cout << std::setw(10) << segments.size() / segmentSeconds / 1e6
+			<< " / " << std::setw(8) << segments.size() / occlusionSeconds / 1e6
+			<< std::setw(17) << linearRays / linearSeconds / 1e6
+			<< std::setw(12) << mismatches
+			<< std::setw(9) << std::setprecision(1) << 100.0 * hits / (kernels.size() * rays.size() + 2 * segments.size() + linearRays) << "\n";
+	}
+
+	// Build quality against build time: more split planes give a lower SAH cost and
+	// faster rays at the price of a slower build, more threads only the latter
+	SceneGeometry& geometry = *geometryPointer;
+	std::cout << "\n" << std::setw(12) << "objects" << std::setw(8) << "bins" << std::setw(10) << "threads"
+		<< std::setw(12) << "build ms" << std::setw(10) << "SAH cost" << std::setw(14) << "BVH Mrays/s" << "\n";
+	std::vector<size_t> threadCounts{ 1 };
+	if (ThreadPool::hardwareThreads() > 1)
+		threadCounts.push_back(ThreadPool::hardwareThreads());
+	for (int bins : { 4, 8, 16, 32, 64 })
+	{
+		for (size_t threads : threadCounts)
+		{
+			geometry.buildBvh(BvhBuildSettings{ bins, threads });
+			const BvhBuildStats& stats = geometry._bvh.buildStats();
+
+			size_t hits = 0;
+			const auto start = Clock::now();
+			for (const Ray& ray : rays)
+				hits += rayIntersection(ray, geometry).has_value();
+			const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			std::cout << std::setw(12) << geometry._bvh.numPrimitives() << std::setw(8) << bins
+				<< std::setw(10) << stats._numThreads << std::setw(12) << std::setprecision(1) << stats._seconds * 1e3
+				<< std::setw(10) << stats._sahCost << std::setw(14) << std::setprecision(4) << rays.size() / seconds / 1e6
+				<< (hits == 0 ? " no hits" : "") << "\n";
+		}
+	}
+	return 0;
+}
@@ -4,66 +4,98 @@
 #include <glm/glm.hpp>
 #include <chrono>
 #include <list>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <array>
+#include <optional>
 
-#include "lodepng.h"
 #include "ray.hpp"
 #include "glm/gtx/string_cast.hpp"
 #include "util.hpp"
+#include "random.hpp"
+#include "arena.hpp"
+#include "wavefront.hpp"
+#include "diagnostics.hpp"
 
 Camera::Camera()
 	: WIDTH{ Config::resolution() }, HEIGHT{ Config::resolution() },
 	  pixelSideLength{ 2.0f / Config::resolution() },
-	  _gen{ std::random_device{}() }, _rng{ 0.f, 1.f }
+	  _frameBuffer{ WIDTH, HEIGHT }
 {
 }
 
 std::chrono::duration<double> Camera::render(Scene& scene)
 {
-	static int feedbackCheckpointMod = (Config::samplesPerPixel() > 20) ? Config::samplesPerPixel() / 20 : 5;
+	return render(scene, Config::shardRegion());
+}
 
+std::chrono::duration<double> Camera::render(Scene& scene, const Tile& cropWindow)
+{
 	std::cout << "Start rendering...\n";
 	auto startTime = std::chrono::high_resolution_clock::now();
 
-	//Get number of usable threads if possible, otherwise just use 1 thread
-	size_t numCores = std::thread::hardware_concurrency();
-	numCores = numCores == 0 ? 1 : numCores;
+	// The pool lives for the whole render, tiles are handed out as tasks and
+	// idle workers steal tiles from busy ones
+	ThreadPool pool{ ThreadPool::hardwareThreads() };
 
-	std::cout << "Available threads: " << numCores << "\n";
+	std::cout << "Available threads: " << pool.size() << "\n";
 
-	for (int i = 0; i < Config::samplesPerPixel(); i++)
+	// Tiles are visited along a Morton curve to keep neighbouring work close in cache,
+	// only the parts of them inside the crop window are rendered
+	std::vector<Tile> tiles;
+	for (const Tile& tile : mortonOrderedTiles(WIDTH, HEIGHT, Config::tileSize()))
 	{
-		// Give some indication of progress in a not so elegant way
-		if (i % feedbackCheckpointMod == 0 && i != 0)
-		{
-			double percentDone = (100.0 * i) / Config::samplesPerPixel();
-			double factorDone = percentDone / 100.0;
-			auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
-			auto estimatedRemaining = (elapsed / factorDone) * (1 - factorDone);
-			std::cout << std::setw(2) << percentDone << "%\tEstimated remaining: "
-				<< durationFormat(estimatedRemaining) << "\n";
-		}
+		Tile clipped{
+			std::max(tile.x0, cropWindow.x0), std::max(tile.y0, cropWindow.y0),
+			std::min(tile.x1, cropWindow.x1), std::min(tile.y1, cropWindow.y1) };
+		if (clipped.width() > 0 && clipped.height() > 0)
+			tiles.push_back(clipped);
+	}
 
-		for (int row = 0; row < HEIGHT; row += numCores)
-		{
+	_sampler = makeSampler(Config::samplerType(), Config::seed(), Config::samplesPerPixel(), WIDTH);
+	// Chosen once, the tiles then run without looking at these settings again
+	_samplePixelsKernel = withKernelSettings([](auto settings) -> SamplePixelsKernel {
+		using Settings = decltype(settings);
+		if (Config::useWavefront())
+			return &Camera::samplePixelsWavefront<Settings>;
+		return &Camera::samplePixelsPacketed<Settings>;
+	});
+	_wavefrontRaysExtended = 0;
+	_wavefrontExtendSeconds = 0.0;
+	scene._terminationPolicy.resetStatistics();
+	Diagnostics::reset();
 
-			std::vector<std::thread> threads;
-		
-			for (size_t i = 0; (i < numCores) && (row + i < HEIGHT); i++)
-			{
-				threads.push_back(std::thread(&Camera::renderThreadFunction, this, row + i, std::ref(scene)));
-			}
-		
-			for (auto& thread : threads)
-			{
-				thread.join();
-			}
-		}
+	// A fresh render has no completed tiles, a resumed one keeps those from the checkpoint
+	if (_completedTiles.size() != tiles.size())
+		_completedTiles.assign(tiles.size(), 0);
 
+	const bool useCheckpoints = !Config::checkpointFile().empty();
+	if (useCheckpoints)
+	{
+		_checkpointBuffer = _frameBuffer;
+		_lastCheckpoint = startTime;
 	}
 
-	for (size_t row = 0; row < HEIGHT; ++row)
-		for (size_t col = 0; col < WIDTH; ++col)
-			_pixels[row][col]._color /= Config::samplesPerPixel();
+	if (Config::timeBudget() > 0.0)
+		renderProgressive(pool, tiles, scene, startTime);
+	else
+		renderAllTiles(pool, tiles, scene, startTime);
+
+	// The final checkpoint holds the finished accumulation buffer
+	if (useCheckpoints)
+		saveCheckpoint(_frameBuffer);
+
+	// A region shard only renders its region, the rest of the buffer is empty or composited
+	const Tile region = Config::shardRegion();
+	uint64_t regionSamples = 0;
+	for (int row = region.y0; row < region.y1; ++row)
+		for (int col = region.x0; col < region.x1; ++col)
+			regionSamples += _frameBuffer.getSampleCount(_frameBuffer.pixelIndex(row, col));
+	_averageSamplesPerPixel = region.area() > 0 ? static_cast<double>(regionSamples) / region.area() : 0.0;
+
+	_frameBuffer.resolve();
 
 	auto endTime = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> duration = endTime - startTime;
@@ -75,122 +107,455 @@ std::chrono::duration<double> Camera::render(Scene& scene)
 		"| |    | | | | | \\__ \\ | | |  __/ (_| |_|\n"
 		"|_|    |_|_| |_|_|___/_| |_|\\___|\\__,_(_)\n";
 	std::cout << finsihedText << "completed in " << durationFormat(duration) << "\n\n";
+
+	scene._terminationPolicy.printStatistics();
+	Diagnostics::print();
+
+	// Summed over all threads, so this is the rate of a single one
+	if (Config::useWavefront() && _wavefrontExtendSeconds > 0.0)
+	{
+		std::cout << "Wavefront extend: " << _wavefrontRaysExtended << " rays, "
+			<< _wavefrontRaysExtended / _wavefrontExtendSeconds / 1e6 << " Mrays/s per thread, secondary ray sorting "
+			<< (Config::sortSecondaryRays() ? "on" : "off") << "\n\n";
+	}
 	return duration;
 }
 
-void Camera::renderThreadFunction(int row, Scene& scene)
+void Camera::renderAllTiles(ThreadPool& pool, const std::vector<Tile>& tiles, Scene& scene,
+	std::chrono::high_resolution_clock::time_point startTime)
 {
-	for (int col = 0; col < WIDTH; ++col)
+	const size_t feedbackCheckpointMod = (tiles.size() > 20) ? tiles.size() / 20 : 1;
+	const bool useCheckpoints = !Config::checkpointFile().empty();
+	std::atomic<size_t> tilesDone{ 0 };
+	std::mutex feedbackMutex;
+
+	// Every tile gets all of its samples before the worker moves on
+	pool.parallelFor(tiles.size(), [&](size_t tileIndex) {
+		// Finished before the render was resumed
+		if (_completedTiles[tileIndex])
+		{
+			++tilesDone;
+			return;
+		}
+
+		if (Config::adaptiveSampling())
+			renderTileAdaptive(tiles[tileIndex], scene);
+		else
+			renderTile(tiles[tileIndex], scene, Config::shardSamplesPerPixel());
+
+		if (useCheckpoints)
+			checkpointTile(tiles[tileIndex], tileIndex);
+		else
+			_completedTiles[tileIndex] = 1;
+
+		// Give some indication of progress in a not so elegant way
+		size_t done = ++tilesDone;
+		if (done % feedbackCheckpointMod == 0 && done != tiles.size())
+		{
+			double percentDone = (100.0 * done) / tiles.size();
+			double factorDone = percentDone / 100.0;
+			auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
+			auto estimatedRemaining = (elapsed / factorDone) * (1 - factorDone);
+
+			std::lock_guard<std::mutex> lock{ feedbackMutex };
+			std::cout << std::setw(2) << percentDone << "%\tEstimated remaining: "
+				<< durationFormat(estimatedRemaining) << "\n";
+		}
+	});
+
+	if (Config::adaptiveSampling())
+		printAdaptiveStatistics();
+}
+
+void Camera::renderProgressive(ThreadPool& pool, const std::vector<Tile>& tiles, Scene& scene,
+	std::chrono::high_resolution_clock::time_point startTime)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const std::chrono::duration<double> budget{ Config::timeBudget() };
+	const int samplesPerPass = std::max(Config::samplesPerPass(), 1);
+
+	const bool useCheckpoints = !Config::checkpointFile().empty();
+
+	std::cout << "Rendering progressively for " << durationFormat(budget) << "\n";
+
+	int passes = 0;
+	std::chrono::duration<double> slowestPass{ 0.0 };
+
+	// Only start a new pass if the slowest one so far still fits in what is left of
+	// the budget, so the deadline is not overshot by more than the estimate is off
+	while (true)
 	{
-			// Small offsets for antialiasing
-			float yOffset = _rng(_gen);
-			float zOffset = _rng(_gen);
-
-			Vertex pixelPoint{
-				0.0f,
-				(col - (WIDTH / 2 + 1) + yOffset) * pixelSideLength,
-				(row - (HEIGHT / 2 + 1) + zOffset) * pixelSideLength,
-				1.0f
-			};
-
-			auto ray = std::make_shared<Ray>(Config::eyeToggle() ? _eyePoint1 : _eyePoint2, pixelPoint, Color{ 1.0, 1.0, 1.0 });
-
-			_pixels[row][col].addRay(ray);
-			Color contrib = scene.raycastScene(*ray);
-			_pixels[row][col]._color += contrib;
+		std::chrono::duration<double> remaining = budget - (Clock::now() - startTime);
+		if (passes > 0 && slowestPass > remaining)
+			break;
+
+		auto passStart = Clock::now();
+		pool.parallelFor(tiles.size(), [&](size_t tileIndex) {
+			renderTile(tiles[tileIndex], scene, samplesPerPass);
+		});
+		std::chrono::duration<double> passDuration = Clock::now() - passStart;
+		slowestPass = std::max(slowestPass, passDuration);
+
+		++passes;
+		++_passesCompleted;
+
+		// All workers are idle between passes so the buffer can be written as it is
+		if (useCheckpoints && checkpointDue())
+			saveCheckpoint(_frameBuffer);
+
+		std::chrono::duration<double> budgetLeft = budget - (Clock::now() - startTime);
+		std::cout << "Pass " << _passesCompleted << " done, " << _passesCompleted * samplesPerPass << " spp\tBudget remaining: "
+			<< durationFormat(std::max(budgetLeft, std::chrono::duration<double>{ 0.0 })) << "\n";
 	}
+
+	std::cout << "Time budget reached after " << passes << " passes, "
+		<< _passesCompleted * samplesPerPass << " spp\n";
 }
 
-void Camera::sqrtAllPixels()
+void Camera::renderTile(const Tile& tile, Scene& scene, int samples)
+{
+	std::vector<size_t> pixels;
+	pixels.reserve(tile.area());
+	for (int row = tile.y0; row < tile.y1; ++row)
+		for (int col = tile.x0; col < tile.x1; ++col)
+			pixels.push_back(_frameBuffer.pixelIndex(row, col));
+
+	samplePixels(pixels, samples, scene);
+}
+
+void Camera::renderTileAdaptive(const Tile& tile, Scene& scene)
 {
-	for (size_t row = 0; row < HEIGHT; ++row)
+	std::vector<size_t> activePixels;
+	activePixels.reserve(tile.area());
+	for (int row = tile.y0; row < tile.y1; ++row)
+		for (int col = tile.x0; col < tile.x1; ++col)
+			activePixels.push_back(_frameBuffer.pixelIndex(row, col));
+
+	// The tile may spend what a fixed samplesPerPixel render would, counting samples
+	// a resumed render already took
+	int64_t budget = static_cast<int64_t>(Config::samplesPerPixel()) * tile.area();
+	for (size_t index : activePixels)
+		budget -= _frameBuffer.getSampleCount(index);
+
+	// Every pixel gets the minimum amount of samples so the variance estimate means something
+	samplePixels(activePixels, Config::minSamplesPerPixel(), scene);
+	budget -= static_cast<int64_t>(Config::minSamplesPerPixel()) * activePixels.size();
+
+	// What the converged pixels leave goes to the noisiest half of the rest, one sample per round
+	std::vector<size_t> noisiest;
+	while (budget > 0)
 	{
-		for (size_t col = 0; col < WIDTH; ++col)
-		{
-			const Color& color = _pixels[row][col]._color;
-			if (someComponent(color, static_cast<bool(*)(double)>(&std::isnan)) ||
-				someComponent(color, static_cast<bool(*)(double)>(&std::isinf)) ||
-				someComponent(color, [](double val) { return val < 0; }))
-			{
-				std::cout << "Problem pixel detected, value: " << glm::to_string(color) << "\n";
-				//_pixels[row][col]._color = Color{ 1,0,0 };
-			}
+		activePixels.erase(
+			std::remove_if(activePixels.begin(), activePixels.end(),
+				[this](size_t index) { return pixelConverged(index); }),
+			activePixels.end());
 
-			_pixels[row][col]._color = glm::sqrt(glm::max(_pixels[row][col]._color, 0.0));
-		}
+		if (activePixels.empty())
+			break;
+
+		const size_t count = static_cast<size_t>(std::min<int64_t>(budget, (activePixels.size() + 1) / 2));
+		noisiest = activePixels;
+		std::nth_element(noisiest.begin(), noisiest.begin() + (count - 1), noisiest.end(),
+			[this](size_t a, size_t b) { return pixelError(a) > pixelError(b); });
+		noisiest.resize(count);
+
+		// Back in tile order so neighbouring pixels still end up in the same packets
+		std::sort(noisiest.begin(), noisiest.end());
+		samplePixels(noisiest, 1, scene);
+		budget -= static_cast<int64_t>(count);
 	}
 }
 
-void Camera::limitRange(double upperBound)
+void Camera::samplePixels(const std::vector<size_t>& pixels, int samples, Scene& scene)
 {
-	for (size_t row = 0; row < HEIGHT; ++row)
-		for (size_t col = 0; col < WIDTH; ++col)
+	(this->*_samplePixelsKernel)(pixels, samples, scene);
+}
+
+template<typename Settings>
+void Camera::samplePixelsPacketed(const std::vector<size_t>& pixels, int samples, Scene& scene)
+{
+	// Neighbouring pixels of the list make up the packets, rows of the tile
+	const size_t packetSize = Config::packetSize();
+	// Recorded with the termination policy once for all samples, the counters are shared by all workers
+	PathStatistics statistics;
+	for (int sample = 0; sample < samples; ++sample)
+	{
+		if (packetSize == 1)
 		{
-			_pixels[row][col]._color = glm::clamp(_pixels[row][col]._color, 0.0, upperBound);
+			for (size_t index : pixels)
+				samplePixel<Settings>(index, scene, statistics);
+			continue;
 		}
+
+		for (size_t first = 0; first < pixels.size(); first += packetSize)
+			samplePacket<Settings>(&pixels[first], std::min(packetSize, pixels.size() - first), scene, statistics);
+	}
+	scene._terminationPolicy.record(statistics);
 }
 
-void Camera::normalize()
+template<typename Settings>
+void Camera::samplePixelsWavefront(const std::vector<size_t>& pixels, int samples, Scene& scene)
 {
-	double maxIntensity = 0.0f;
-	for (size_t row = 0; row < HEIGHT; ++row)
-		for (size_t col = 0; col < WIDTH; ++col)
-		{
-			const Color& color = _pixels[row][col]._color;
-			double maxOfPixel = glm::max(glm::max(color.r, color.g), color.b);
-			if (maxOfPixel > maxIntensity)
-				maxIntensity = maxOfPixel;
+	// Every worker keeps its queues, they only grow until they fit a batch
+	thread_local WavefrontIntegrator wavefront;
+
+	// Keeps the queues of a batch from growing without bounds for high sample counts
+	const int samplesPerBatch = std::max(1, static_cast<int>(MAX_WAVEFRONT_PATHS / std::max<size_t>(pixels.size(), 1)));
+
+	for (int firstSample = 0; firstSample < samples; firstSample += samplesPerBatch)
+	{
+		const int batchSamples = std::min(samplesPerBatch, samples - firstSample);
 
-			if (someComponent(color, static_cast<bool(*)(double)>(&std::isnan)))
-				std::cout << "Pixel with NaN detected, value: " << glm::to_string(color) << "\n";
+		wavefront.clear();
+		for (int sample = 0; sample < batchSamples; ++sample)
+		{
+			for (size_t index : pixels)
+			{
+				// The samples are only added once the batch is done, so count ahead
+				RandomStream random{ *_sampler, static_cast<uint32_t>(index), sampleIndex(index, sample) };
+				wavefront.addPath(primaryRay(static_cast<int>(index / WIDTH), static_cast<int>(index % WIDTH), random), random);
+			}
 		}
 
-	for (size_t row = 0; row < HEIGHT; ++row)
-		for (size_t col = 0; col < WIDTH; ++col)
+		wavefront.trace<Settings>(scene);
 		{
-			_pixels[row][col]._color = _pixels[row][col]._color / maxIntensity;
+			std::lock_guard<std::mutex> lock{ _wavefrontStatisticsMutex };
+			_wavefrontRaysExtended += wavefront.raysExtended();
+			_wavefrontExtendSeconds += wavefront.extendSeconds();
 		}
+
+		// Slots were handed out in the order the paths were added
+		const std::vector<Color>& radiance = wavefront.radiance();
+		size_t slot = 0;
+		for (int sample = 0; sample < batchSamples; ++sample)
+			for (size_t index : pixels)
+				_frameBuffer.addSample(index, radiance[slot++]);
+	}
 }
 
-void Camera::createPNG(const std::string& file)
+double Camera::pixelError(size_t index) const
+{
+	// Half width of the 95% confidence interval relative to the mean, the floor
+	// keeps pixels that are almost black from demanding an absurd precision
+	const double halfWidth = 1.96 * _frameBuffer.getStandardError(index);
+	const double mean = std::max(_frameBuffer.getLuminanceMean(index), 1e-3);
+	return halfWidth / mean;
+}
+
+bool Camera::pixelConverged(size_t index) const
+{
+	if (_frameBuffer.getSampleCount(index) >= static_cast<uint32_t>(Config::maxSamplesPerPixel()))
+		return true;
+
+	return pixelError(index) <= Config::adaptiveErrorThreshold();
+}
+
+uint32_t Camera::sampleIndex(size_t index, uint32_t samplesAhead) const
+{
+	// The pixel's sample count doubles as the sample index, so progressive passes,
+	// adaptive sampling and resumed renders all continue the same sequence. A sample
+	// range shard maps it onto its own share of the sequence
+	return Config::shardFirstSample() +
+		(_frameBuffer.getSampleCount(index) + samplesAhead) * Config::shardSampleStride();
+}
+
+Ray Camera::primaryRay(int row, int col, RandomStream& random) const
+{
+	// Small offsets for antialiasing
+	float yOffset = random.next();
+	float zOffset = random.next();
+
+	Vertex pixelPoint{
+		0.0f,
+		(col - (WIDTH / 2 + 1) + yOffset) * pixelSideLength,
+		(row - (HEIGHT / 2 + 1) + zOffset) * pixelSideLength,
+		1.0f
+	};
+
+	return Ray{ Config::eyeToggle() ? _eyePoint1 : _eyePoint2, pixelPoint };
+}
+
+template<typename Settings>
+void Camera::samplePixel(size_t index, Scene& scene, PathStatistics& statistics)
+{
+	// Nothing allocated while tracing the previous sample is still in use
+	ScratchArena::local().reset();
+
+	RandomStream random{ *_sampler, static_cast<uint32_t>(index), sampleIndex(index, 0) };
+	Ray ray = primaryRay(static_cast<int>(index / WIDTH), static_cast<int>(index % WIDTH), random);
+	_frameBuffer.addSample(index, scene.raycastScene<Settings>(ray, random, statistics));
+}
+
+template<typename Settings>
+void Camera::samplePacket(const size_t* pixels, size_t count, Scene& scene, PathStatistics& statistics)
 {
-	double maxIntensity = 0.0f;
-	for (size_t row = 0; row < HEIGHT; ++row)
+	std::array<RandomStream, MAX_PACKET_SIZE> random;
+	std::array<Ray, MAX_PACKET_SIZE> rays;
+	std::array<std::optional<IntersectionSurface>, MAX_PACKET_SIZE> hits;
+	for (size_t i = 0; i < count; ++i)
 	{
-		for (size_t col = 0; col < WIDTH; ++col)
-		{
-			const Color& color = _pixels[row][col]._color;
-			double maxOfPixel = glm::max(glm::max(color.r, color.g), color.b);
-			if (maxOfPixel > maxIntensity)
-				maxIntensity = maxOfPixel;
+		const size_t index = pixels[i];
+		random[i] = RandomStream{ *_sampler, static_cast<uint32_t>(index), sampleIndex(index, 0) };
+		rays[i] = primaryRay(static_cast<int>(index / WIDTH), static_cast<int>(index % WIDTH), random[i]);
+	}
 
-			if (someComponent(color,  static_cast<bool(*)(double)>(&std::isnan)))
-				std::cout << "Pixel with NaN detected, value: " << glm::to_string(color) << "\n";
-		}
+	scene._packetGeometry.intersect(rays.data(), count, hits.data());
+
+	// From the first hit on every path goes its own way
+	for (size_t i = 0; i < count; ++i)
+	{
+		ScratchArena::local().reset();
+		_frameBuffer.addSample(pixels[i], scene.raycastScene<Settings>(rays[i], hits[i], random[i], statistics));
 	}
+}
 
-	std::cout << "Maximum intensity found: " << maxIntensity << '\n';
-	std::cout << "Start writing to file...\n";
-	
-	std::vector<unsigned char> image;
-	image.resize(WIDTH * HEIGHT * 4);
+void Camera::printAdaptiveStatistics() const
+{
+	const size_t samplesTaken = _frameBuffer.totalSamples();
+	const size_t numPixels = _frameBuffer.size();
+	// What the same render without adaptive sampling takes
+	const size_t fixedSamples = numPixels * Config::samplesPerPixel();
+	const double saved = static_cast<double>(fixedSamples) - static_cast<double>(samplesTaken);
 
-	for (size_t row = 0; row < HEIGHT; ++row)
+	size_t pixelsAboveFixed = 0;
+	size_t pixelsAtMax = 0;
+	for (size_t i = 0; i < numPixels; ++i)
 	{
-		for (size_t col = 0; col < WIDTH; col++)
-		{
-			unsigned char r = static_cast<unsigned char>(_pixels[row][col]._color.r * 255.99f / maxIntensity);
-			unsigned char g = static_cast<unsigned char>(_pixels[row][col]._color.g * 255.99f / maxIntensity);
-			unsigned char b = static_cast<unsigned char>(_pixels[row][col]._color.b * 255.99f / maxIntensity);
-
-			image[(HEIGHT - 1 - row) * 4 * WIDTH + (WIDTH - 1 - col) * 4 + 0] = r;
-			image[(HEIGHT - 1 - row) * 4 * WIDTH + (WIDTH - 1 - col) * 4 + 1] = g;
-			image[(HEIGHT - 1 - row) * 4 * WIDTH + (WIDTH - 1 - col) * 4 + 2] = b;
-			image[(HEIGHT - 1 - row) * 4 * WIDTH + (WIDTH - 1 - col) * 4 + 3] = 255;
-		}
+		const uint32_t samples = _frameBuffer.getSampleCount(i);
+		if (samples > static_cast<uint32_t>(Config::samplesPerPixel()))
+			++pixelsAboveFixed;
+		if (samples >= static_cast<uint32_t>(Config::maxSamplesPerPixel()))
+			++pixelsAtMax;
 	}
 
-	unsigned error = lodepng::encode(file, image, WIDTH, HEIGHT);
-	if (error) std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
-	else std::cout << "Done!\n";
+	std::cout << "Adaptive sampling: " << samplesTaken << " samples taken, "
+		<< static_cast<double>(samplesTaken) / numPixels << " spp on average\n"
+		<< "  " << pixelsAboveFixed << " of " << numPixels << " pixels got more than "
+		<< Config::samplesPerPixel() << " spp, " << pixelsAtMax << " reached the maximum of "
+		<< Config::maxSamplesPerPixel() << " spp\n"
+		<< "  " << saved << " samples saved (" << (100.0 * saved) / fixedSamples << "%) compared to "
+		<< Config::samplesPerPixel() << " spp everywhere\n";
+}
+
+bool Camera::resumeFrom(const std::string& file)
+{
+	CheckpointHeader header;
+	FrameBuffer loaded{ 0, 0 };
+	if (!readCheckpoint(file, header, loaded))
+		return false;
+
+	if (header.configHash != Config::renderSettingsHash() ||
+		loaded.width() != WIDTH || loaded.height() != HEIGHT)
+	{
+		std::cout << "Checkpoint " << file << " was made with different render settings, not resuming\n";
+		return false;
+	}
+
+	_frameBuffer = std::move(loaded);
+	_completedTiles = std::move(header.completedTiles);
+	_passesCompleted = header.passesCompleted;
+
+	std::cout << "Resuming from " << file << " with " << _frameBuffer.totalSamples() << " samples already taken\n";
+	return true;
+}
+
+bool Camera::compositeOnto(const std::string& file, const Tile& cropWindow)
+{
+	CheckpointHeader header;
+	FrameBuffer loaded{ 0, 0 };
+	if (!readCheckpoint(file, header, loaded))
+		return false;
+
+	// The settings may well have changed, that is usually why a region is rerendered
+	if (loaded.width() != WIDTH || loaded.height() != HEIGHT)
+	{
+		std::cout << "Accumulation file " << file << " is " << loaded.width() << "x" << loaded.height()
+			<< ", not " << WIDTH << "x" << HEIGHT << "\n";
+		return false;
+	}
+
+	_frameBuffer = std::move(loaded);
+	_frameBuffer.clearRegion(cropWindow);
+
+	std::cout << "Compositing a " << cropWindow.width() << "x" << cropWindow.height()
+		<< " crop window onto " << file << "\n";
+	return true;
+}
+
+void Camera::checkpointTile(const Tile& tile, size_t tileIndex)
+{
+	// The tile is not touched again, so it can be copied without stopping the other workers
+	std::unique_lock<std::mutex> lock{ _checkpointMutex };
+	_checkpointBuffer.copyRegion(_frameBuffer, tile);
+	_completedTiles[tileIndex] = 1;
+
+	if (_checkpointWriting || !checkpointDue())
+		return;
+
+	// Only the copy happens under the lock, this worker writes the file on its own
+	_checkpointWriting = true;
+	_checkpointSnapshot = _checkpointBuffer;
+	const CheckpointHeader header = checkpointHeader();
+	lock.unlock();
+
+	const bool written = writeCheckpointFile(header, _checkpointSnapshot);
+
+	lock.lock();
+	_checkpointWriting = false;
+	if (written)
+		_lastCheckpoint = std::chrono::high_resolution_clock::now();
+}
+
+bool Camera::checkpointDue() const
+{
+	std::chrono::duration<double> sinceLast = std::chrono::high_resolution_clock::now() - _lastCheckpoint;
+	return sinceLast.count() >= Config::checkpointInterval();
+}
+
+void Camera::saveCheckpoint(const FrameBuffer& source)
+{
+	if (writeCheckpointFile(checkpointHeader(), source))
+		_lastCheckpoint = std::chrono::high_resolution_clock::now();
+}
+
+CheckpointHeader Camera::checkpointHeader() const
+{
+	CheckpointHeader header;
+	header.configHash = Config::renderSettingsHash();
+	header.frameHash = Config::frameSettingsHash();
+	header.passesCompleted = _passesCompleted;
+	header.completedTiles = _completedTiles;
+	header.seed = Config::seed();
+	return header;
+}
+
+bool Camera::writeCheckpointFile(const CheckpointHeader& header, const FrameBuffer& source) const
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (!writeCheckpoint(Config::checkpointFile(), header, source))
+		return false;
+
+	std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+	std::cout << "Checkpoint written to " << Config::checkpointFile() << " in " << duration.count() << "s\n";
+	return true;
+}
+
+void Camera::sqrtAllPixels()
+{
+	_frameBuffer.sqrtAllPixels();
+}
+
+void Camera::limitRange(double upperBound)
+{
+	_frameBuffer.limitRange(upperBound);
+}
+
+void Camera::normalize()
+{
+	_frameBuffer.normalize();
+}
+
+void Camera::createPNG(const std::string& file)
+{
+	_frameBuffer.createPNG(file);
 }
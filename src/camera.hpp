@@ -1,23 +1,43 @@
 #pragma once
 
 #include <vector>
-#include <random>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
 
 #include "basic_types.hpp"
 #include "scene.hpp"
 #include "config.hpp"
+#include "tile.hpp"
+#include "framebuffer.hpp"
+#include "checkpoint.hpp"
+#include "threadpool.hpp"
+#include "sampler.hpp"
+#include "random.hpp"
+#include "ray.hpp"
 
 class Camera
 {
 public:
 	Camera();
 
+	// Renders the crop window from the config, the whole image unless one is set
 	std::chrono::duration<double> render(Scene& scene);
+	// Only generates rays for the pixels inside cropWindow, the others are left as they are
+	std::chrono::duration<double> render(Scene& scene, const Tile& cropWindow);
+	// Loads a checkpoint written with the same settings, the next render continues from it
+	bool resumeFrom(const std::string& file);
+	// Loads the accumulation buffer of an earlier full frame render, the next render
+	// replaces the pixels inside cropWindow and keeps the rest
+	bool compositeOnto(const std::string& file, const Tile& cropWindow);
 	void limitRange(double upperBound);
 	void normalize();
 	void sqrtAllPixels();
 	void createPNG(const std::string& file);
 
+	// The samples per pixel the last render actually reached in the shard region
+	double averageSamplesPerPixel() const { return _averageSamplesPerPixel; }
+
 private:
 	const Vertex _eyePoint1{ -2.0f, 0.0f, 0.0f, 1.0f };
 	const Vertex _eyePoint2{ -1.0f, 0.0f, 0.0f, 1.0f };
@@ -26,13 +46,63 @@ private:
 	const int WIDTH;
 	const int HEIGHT;
 	const float pixelSideLength;
+
+	// Upper bound on the camera paths a wavefront batch starts with
+	static constexpr size_t MAX_WAVEFRONT_PATHS = 1 << 16;
 	
-	using PixelGrid = std::vector<std::vector<Pixel>>;
-	PixelGrid _pixels{ HEIGHT, std::vector<Pixel>(WIDTH) };
+	FrameBuffer _frameBuffer;
+	double _averageSamplesPerPixel = 0.0;
+	std::unique_ptr<Sampler> _sampler;
+
+	using SamplePixelsKernel = void (Camera::*)(const std::vector<size_t>&, int, Scene&);
+	SamplePixelsKernel _samplePixelsKernel = nullptr;
+
+	// How fast the wavefront extend stage went over the whole render
+	uint64_t _wavefrontRaysExtended = 0;
+	double _wavefrontExtendSeconds = 0.0;
+	std::mutex _wavefrontStatisticsMutex;
+
+	// Checkpoint stuff, the checkpoint buffer only receives tiles once they are completed.
+	// A worker that finds a checkpoint due copies it to the snapshot and writes that
+	// without holding the mutex, the others only wait for the copy
+	FrameBuffer _checkpointBuffer{ 0, 0 };
+	FrameBuffer _checkpointSnapshot{ 0, 0 };
+	std::vector<uint8_t> _completedTiles;
+	uint32_t _passesCompleted = 0;
+	std::mutex _checkpointMutex;
+	bool _checkpointWriting = false;
+	std::chrono::high_resolution_clock::time_point _lastCheckpoint;
 
-	// Random generator stuff
-	std::mt19937 _gen;
-	std::uniform_real_distribution<float> _rng;
+	void renderAllTiles(ThreadPool& pool, const std::vector<Tile>& tiles, Scene& scene,
+		std::chrono::high_resolution_clock::time_point startTime);
+	void renderProgressive(ThreadPool& pool, const std::vector<Tile>& tiles, Scene& scene,
+		std::chrono::high_resolution_clock::time_point startTime);
+	void renderTile(const Tile& tile, Scene& scene, int samples);
+	void renderTileAdaptive(const Tile& tile, Scene& scene);
+	// Takes samples more samples for each of pixels, one round over all of them at a time
+	void samplePixels(const std::vector<size_t>& pixels, int samples, Scene& scene);
+	// The samplePixels kernels for each KernelSettings, render picks the one for the config
+	template<typename Settings>
+	void samplePixelsPacketed(const std::vector<size_t>& pixels, int samples, Scene& scene);
+	template<typename Settings>
+	void samplePixelsWavefront(const std::vector<size_t>& pixels, int samples, Scene& scene);
+	template<typename Settings>
+	void samplePixel(size_t index, Scene& scene, PathStatistics& statistics);
+	// One sample for each of the count pixels, their camera rays are intersected as one packet
+	template<typename Settings>
+	void samplePacket(const size_t* pixels, size_t count, Scene& scene, PathStatistics& statistics);
+	// The sample index of the pixel's sample samplesAhead after the ones already taken
+	uint32_t sampleIndex(size_t index, uint32_t samplesAhead) const;
+	Ray primaryRay(int row, int col, RandomStream& random) const;
+	// Half width of the pixel's 95% confidence interval relative to its mean
+	double pixelError(size_t index) const;
+	bool pixelConverged(size_t index) const;
+	void printAdaptiveStatistics() const;
 
-	void renderThreadFunction(int row, Scene& scene);
+	void checkpointTile(const Tile& tile, size_t tileIndex);
+	bool checkpointDue() const;
+	void saveCheckpoint(const FrameBuffer& source);
+	CheckpointHeader checkpointHeader() const;
+	// Writes the checkpoint file, false if that failed
+	bool writeCheckpointFile(const CheckpointHeader& header, const FrameBuffer& source) const;
 };
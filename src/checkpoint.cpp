@@ -0,0 +1,111 @@
+#include "checkpoint.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+
+namespace
+{
+	constexpr char MAGIC[4] = { 'M', 'C', 'C', 'K' };
+	constexpr uint32_t VERSION = 3;
+
+	template<typename T>
+	void writeValue(std::ostream& stream, const T& value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	T readValue(std::istream& stream)
+	{
+		T value{};
+		stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+}
+
+bool writeCheckpoint(const std::string& path, const CheckpointHeader& header, const FrameBuffer& frameBuffer)
+{
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+		if (!file)
+		{
+			std::cout << "Could not open checkpoint file " << tempPath << " for writing\n";
+			return false;
+		}
+
+		file.write(MAGIC, sizeof(MAGIC));
+		writeValue(file, VERSION);
+		writeValue(file, header.configHash);
+		writeValue(file, header.frameHash);
+		writeValue(file, static_cast<int32_t>(frameBuffer.width()));
+		writeValue(file, static_cast<int32_t>(frameBuffer.height()));
+		writeValue(file, header.passesCompleted);
+
+		writeValue(file, static_cast<uint32_t>(header.completedTiles.size()));
+		file.write(reinterpret_cast<const char*>(header.completedTiles.data()), header.completedTiles.size());
+
+		writeValue(file, header.seed);
+
+		frameBuffer.write(file);
+
+		if (!file)
+		{
+			std::cout << "Failed writing checkpoint file " << tempPath << "\n";
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::cout << "Could not move checkpoint into place: " << error.message() << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool readCheckpoint(const std::string& path, CheckpointHeader& header, FrameBuffer& frameBuffer)
+{
+	std::ifstream file{ path, std::ios::binary };
+	if (!file)
+	{
+		std::cout << "Could not open checkpoint file " << path << "\n";
+		return false;
+	}
+
+	char magic[4];
+	file.read(magic, sizeof(magic));
+	if (!file || !std::equal(magic, magic + 4, MAGIC) || readValue<uint32_t>(file) != VERSION)
+	{
+		std::cout << path << " is not a checkpoint file of a supported version\n";
+		return false;
+	}
+
+	header.configHash = readValue<uint64_t>(file);
+	header.frameHash = readValue<uint64_t>(file);
+	const int32_t width = readValue<int32_t>(file);
+	const int32_t height = readValue<int32_t>(file);
+	header.passesCompleted = readValue<uint32_t>(file);
+
+	header.completedTiles.resize(readValue<uint32_t>(file));
+	file.read(reinterpret_cast<char*>(header.completedTiles.data()), header.completedTiles.size());
+
+	header.seed = readValue<uint64_t>(file);
+
+	if (!file || width <= 0 || height <= 0)
+	{
+		std::cout << "Checkpoint file " << path << " has a broken header\n";
+		return false;
+	}
+
+	frameBuffer = FrameBuffer{ width, height };
+	if (!frameBuffer.read(file))
+	{
+		std::cout << "Checkpoint file " << path << " is truncated\n";
+		return false;
+	}
+	return true;
+}
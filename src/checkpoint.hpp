@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "framebuffer.hpp"
+
+// Everything besides the accumulation buffer that is needed to continue a render
+struct CheckpointHeader
+{
+	uint64_t configHash = 0;
+	// Shared by all shards of one frame
+	uint64_t frameHash = 0;
+	uint32_t passesCompleted = 0;
+	std::vector<uint8_t> completedTiles;
+	// Together with the sample counts this is all the random number state there is
+	uint64_t seed = 0;
+};
+
+// Writes header and frameBuffer to path + ".tmp" and then renames it to path,
+// so a render that is killed mid write never leaves a broken checkpoint behind
+bool writeCheckpoint(const std::string& path, const CheckpointHeader& header, const FrameBuffer& frameBuffer);
+
+// Replaces header and frameBuffer with the contents of the checkpoint at path
+bool readCheckpoint(const std::string& path, CheckpointHeader& header, FrameBuffer& frameBuffer);
@@ -1,5 +1,22 @@
 #include "config.hpp"
 
+#include <iostream>
+
+namespace
+{
+	// One FNV-1a step over the raw bytes of value
+	template <typename T>
+	void hashBytes(uint64_t& hash, const T& value)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+		for (size_t i = 0; i < sizeof(value); ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+}
+
 Config& Config::instance()
 {
 	static Config instance;
@@ -21,11 +38,81 @@ bool Config::eyeToggle()
 	return instance()._eyeToggle;
 }
 
+int Config::tileSize()
+{
+	return instance()._tileSize;
+}
+
+bool Config::adaptiveSampling()
+{
+	return instance()._adaptiveSampling;
+}
+
+int Config::minSamplesPerPixel()
+{
+	return instance()._minSamplesPerPixel;
+}
+
+int Config::maxSamplesPerPixel()
+{
+	return instance()._maxSamplesPerPixel;
+}
+
+double Config::adaptiveErrorThreshold()
+{
+	return instance()._adaptiveErrorThreshold;
+}
+
+double Config::timeBudget()
+{
+	return instance()._timeBudget;
+}
+
+int Config::samplesPerPass()
+{
+	return instance()._samplesPerPass;
+}
+
+const std::string& Config::checkpointFile()
+{
+	return instance()._checkpointFile;
+}
+
+double Config::checkpointInterval()
+{
+	return instance()._checkpointInterval;
+}
+
 float Config::monteCarloTerminationProbability()
 {
 	return instance()._monteCarloTerminationProbability;
 }
 
+RouletteMode Config::rouletteMode()
+{
+	return instance()._rouletteMode;
+}
+
+int Config::rouletteMinDepth()
+{
+	return instance()._rouletteMinDepth;
+}
+
+int Config::maxDiffuseDepth()
+{
+	return instance()._maxDiffuseDepth;
+}
+
+int Config::maxSpecularDepth()
+{
+	return instance()._maxSpecularDepth;
+}
+
+int Config::maxTransmissionDepth()
+{
+	return instance()._maxTransmissionDepth;
+}
+
 int Config::numShadowRaysPerIntersection()
 {
 	return instance()._numShadowRaysPerIntersection;
@@ -36,6 +123,108 @@ bool Config::usePhotonMapping()
 	return instance()._usePhotonMapping;
 }
 
+bool Config::useWavefront()
+{
+	return instance()._useWavefront;
+}
+
+int Config::packetSize()
+{
+	return instance()._packetSize;
+}
+
+bool Config::sortSecondaryRays()
+{
+	return instance()._sortSecondaryRays;
+}
+
+int Config::bvhSplitBins()
+{
+	return instance()._bvhSplitBins;
+}
+
+int Config::bvhBuildThreads()
+{
+	return instance()._bvhBuildThreads;
+}
+
+uint64_t Config::seed()
+{
+	return instance()._seed;
+}
+
+SamplerType Config::samplerType()
+{
+	return instance()._samplerType;
+}
+
+Tile Config::shardRegion()
+{
+	const Tile& region = instance()._shardRegion;
+	if (region.width() <= 0 || region.height() <= 0)
+		return Tile{ 0, 0, resolution(), resolution() };
+	return region.clampedTo(resolution(), resolution());
+}
+
+int Config::shardFirstSample()
+{
+	return instance()._shardFirstSample;
+}
+
+int Config::shardSampleStride()
+{
+	return instance()._shardSampleStride;
+}
+
+int Config::shardSamplesPerPixel()
+{
+	return instance()._shardSamplesPerPixel > 0 ? instance()._shardSamplesPerPixel : samplesPerPixel();
+}
+
+uint64_t Config::frameSettingsHash()
+{
+	uint64_t hash = 14695981039346656037ull;
+	const Config& config = instance();
+	hashBytes(hash, config._resolution);
+	hashBytes(hash, config._samplesPerPixel);
+	hashBytes(hash, config._eyeToggle);
+	hashBytes(hash, config._tileSize);
+	hashBytes(hash, config._adaptiveSampling);
+	hashBytes(hash, config._minSamplesPerPixel);
+	hashBytes(hash, config._maxSamplesPerPixel);
+	hashBytes(hash, config._adaptiveErrorThreshold);
+	hashBytes(hash, config._timeBudget > 0.0);
+	hashBytes(hash, config._samplesPerPass);
+	hashBytes(hash, config._monteCarloTerminationProbability);
+	hashBytes(hash, config._rouletteMode);
+	hashBytes(hash, config._rouletteMinDepth);
+	hashBytes(hash, config._maxDiffuseDepth);
+	hashBytes(hash, config._maxSpecularDepth);
+	hashBytes(hash, config._maxTransmissionDepth);
+	hashBytes(hash, config._numShadowRaysPerIntersection);
+	hashBytes(hash, config._usePhotonMapping);
+	hashBytes(hash, config._useWavefront);
+	hashBytes(hash, config._packetSize);
+	hashBytes(hash, config._sortSecondaryRays);
+	hashBytes(hash, config._seed);
+	hashBytes(hash, config._samplerType);
+	return hash;
+}
+
+uint64_t Config::renderSettingsHash()
+{
+	uint64_t hash = frameSettingsHash();
+	const Tile region = shardRegion();
+	hashBytes(hash, region.x0);
+	hashBytes(hash, region.y0);
+	hashBytes(hash, region.x1);
+	hashBytes(hash, region.y1);
+	hashBytes(hash, shardFirstSample());
+	hashBytes(hash, shardSampleStride());
+	hashBytes(hash, shardSamplesPerPixel());
+	return hash;
+}
+
 void Config::setResolution(int res)
 {
 	_resolution = res;
@@ -51,11 +240,73 @@ void Config::setEyeToggle(bool eye)
 	_eyeToggle = eye;
 }
 
+void Config::setTileSize(int size)
+{
+	_tileSize = size;
+}
+
+void Config::setAdaptiveSampling(bool use)
+{
+	_adaptiveSampling = use;
+}
+
+void Config::setMinSamplesPerPixel(int spp)
+{
+	_minSamplesPerPixel = spp;
+}
+
+void Config::setMaxSamplesPerPixel(int spp)
+{
+	_maxSamplesPerPixel = spp;
+}
+
+void Config::setAdaptiveErrorThreshold(double threshold)
+{
+	_adaptiveErrorThreshold = threshold;
+}
+
+void Config::setTimeBudget(double seconds)
+{
+	_timeBudget = seconds;
+}
+
+void Config::setSamplesPerPass(int spp)
+{
+	_samplesPerPass = spp;
+}
+
+void Config::setCheckpointFile(const std::string& file)
+{
+	_checkpointFile = file;
+}
+
+void Config::setCheckpointInterval(double seconds)
+{
+	_checkpointInterval = seconds;
+}
+
 void Config::setMonteCarloTerminationProbability(float prob)
 {
 	_monteCarloTerminationProbability = prob;
 }
 
+void Config::setRouletteMode(RouletteMode mode)
+{
+	_rouletteMode = mode;
+}
+
+void Config::setRouletteMinDepth(int depth)
+{
+	_rouletteMinDepth = depth;
+}
+
+void Config::setMaxDepths(int diffuse, int specular, int transmission)
+{
+	_maxDiffuseDepth = diffuse;
+	_maxSpecularDepth = specular;
+	_maxTransmissionDepth = transmission;
+}
+
 void Config::setNumShadowRaysPerIntersection(int num)
 {
 	_numShadowRaysPerIntersection = num;
@@ -65,3 +316,54 @@ void Config::setUsePhotonMapping(bool use)
 {
 	_usePhotonMapping = use;
 }
+
+void Config::setUseWavefront(bool use)
+{
+	_useWavefront = use;
+}
+
+void Config::setPacketSize(int size)
+{
+	// Only the widths the packet code is written for, anything else is rounded down to one
+	int supported = 1;
+	for (int width : { 4, 8, 16 })
+		if (size >= width)
+			supported = width;
+
+	if (supported != size)
+		std::cout << "Packet size " << size << " is not one of 1, 4, 8 or 16, using " << supported << "\n";
+	_packetSize = supported;
+}
+
+void Config::setSortSecondaryRays(bool sort)
+{
+	_sortSecondaryRays = sort;
+}
+
+void Config::setBvhBuild(int splitBins, int threads)
+{
+	_bvhSplitBins = splitBins;
+	_bvhBuildThreads = threads;
+}
+
+void Config::setSeed(uint64_t seed)
+{
+	_seed = seed;
+}
+
+void Config::setSamplerType(SamplerType type)
+{
+	_samplerType = type;
+}
+
+void Config::setShardRegion(Tile region)
+{
+	_shardRegion = region;
+}
+
+void Config::setShardSampleRange(int firstSample, int stride, int samplesPerPixel)
+{
+	_shardFirstSample = firstSample;
+	_shardSampleStride = stride;
+	_shardSamplesPerPixel = samplesPerPixel;
+}
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <string>
+#include <cstdint>
+
+#include "sampler.hpp"
+#include "tile.hpp"
+#include "termination.hpp"
+
 class Config
 {
 public:
@@ -10,18 +17,73 @@ public:
 	static int resolution();
 	static int samplesPerPixel();
 	static bool eyeToggle();
+	static int tileSize();
+
+	static bool adaptiveSampling();
+	static int minSamplesPerPixel();
+	static int maxSamplesPerPixel();
+	static double adaptiveErrorThreshold();
+
+	static double timeBudget();
+	static int samplesPerPass();
+
+	static const std::string& checkpointFile();
+	static double checkpointInterval();
+
+	static Tile shardRegion();
+	static int shardFirstSample();
+	static int shardSampleStride();
+	static int shardSamplesPerPixel();
 
 	static float monteCarloTerminationProbability();
+	static RouletteMode rouletteMode();
+	static int rouletteMinDepth();
+	static int maxDiffuseDepth();
+	static int maxSpecularDepth();
+	static int maxTransmissionDepth();
 	static int numShadowRaysPerIntersection();
 	
 	static bool usePhotonMapping();
+	static bool useWavefront();
+	static int packetSize();
+	static bool sortSecondaryRays();
+	static int bvhSplitBins();
+	static int bvhBuildThreads();
+	static uint64_t seed();
+	static SamplerType samplerType();
+
+	// Hash of every setting that changes what a render accumulates,
+	// a checkpoint can only be resumed with identical settings
+	static uint64_t renderSettingsHash();
+	// The same without the shard settings, the shards of one frame can be merged if these match
+	static uint64_t frameSettingsHash();
 
 	void setResolution(int res);
 	void setSamplesPerPixel(int spp);
 	void setEyeToggle(bool eye);
+	void setTileSize(int size);
+	void setAdaptiveSampling(bool use);
+	void setMinSamplesPerPixel(int spp);
+	void setMaxSamplesPerPixel(int spp);
+	void setAdaptiveErrorThreshold(double threshold);
+	void setTimeBudget(double seconds);
+	void setSamplesPerPass(int spp);
+	void setCheckpointFile(const std::string& file);
+	void setCheckpointInterval(double seconds);
+	void setShardRegion(Tile region);
+	void setShardSampleRange(int firstSample, int stride, int samplesPerPixel);
 	void setMonteCarloTerminationProbability(float prob);
+	void setRouletteMode(RouletteMode mode);
+	void setRouletteMinDepth(int depth);
+	void setMaxDepths(int diffuse, int specular, int transmission);
 	void setNumShadowRaysPerIntersection(int num);
 	void setUsePhotonMapping(bool use);
+	void setUseWavefront(bool use);
+	void setPacketSize(int size);
+	void setSortSecondaryRays(bool sort);
+	void setBvhBuild(int splitBins, int threads);
+	void setSeed(uint64_t seed);
+	void setSamplerType(SamplerType type);
 
 private:
 	Config() {}
@@ -31,9 +93,65 @@ private:
 	int _resolution = 800;
 	int _samplesPerPixel = 100;
 	bool _eyeToggle = false;
+	int _tileSize = 16;
+
+	// With adaptive sampling every tile spends at most samplesPerPixel per pixel. Every pixel
+	// gets min samples, the rest goes to the noisiest pixels, up to max samples each. A pixel
+	// stops once the 95% confidence interval of its luminance is within threshold * mean
+	bool _adaptiveSampling = false;
+	int _minSamplesPerPixel = 16;
+	int _maxSamplesPerPixel = 400;
+	double _adaptiveErrorThreshold = 0.1;
+
+	// A time budget in seconds above 0 replaces the fixed spp, full image passes of
+	// samplesPerPass samples are rendered until the budget is used up
+	double _timeBudget = 0.0;
+	int _samplesPerPass = 1;
 
+	// An empty file name disables checkpoints, otherwise the accumulation
+	// buffer is written to it every checkpointInterval seconds
+	std::string _checkpointFile;
+	double _checkpointInterval = 300.0;
+
+	// A shard or crop window renders only the pixels inside the region (empty means the whole image)
+	// and samples firstSample, firstSample + stride, ... of each pixel, samplesPerPixel
+	// of them (0 means Config::samplesPerPixel()). Sample ranges only work without adaptive sampling.
+	Tile _shardRegion{ 0, 0, 0, 0 };
+	int _shardFirstSample = 0;
+	int _shardSampleStride = 1;
+	int _shardSamplesPerPixel = 0;
+
+	// Used by the fixed roulette and when tracing photons
 	float _monteCarloTerminationProbability = 0.2f;
+
+	// Camera paths only face Russian roulette after minDepth interactions and never go
+	// deeper than the maximum for each interaction type
+	RouletteMode _rouletteMode = RouletteMode::THROUGHPUT;
+	int _rouletteMinDepth = 3;
+	int _maxDiffuseDepth = 16;
+	int _maxSpecularDepth = 32;
+	int _maxTransmissionDepth = 32;
 	int _numShadowRaysPerIntersection = 1;
 
 	bool _usePhotonMapping = true;
+
+	// Trace the samples of a tile as one batch, stage by stage, instead of path by path
+	bool _useWavefront = false;
+
+	// Camera rays are intersected in packets of 4, 8 or 16 neighbouring pixels, 1 traces them one by one.
+	// setPacketSize rounds other sizes down to one of those
+	int _packetSize = 8;
+
+	// In wavefront mode the rays after the first bounce are sorted by direction and origin before
+	// they are traced. The whole room fits in the cache, so for now this costs more than it saves
+	bool _sortSecondaryRays = false;
+
+	// The BVH tries this many split planes per axis, more take longer to build and
+	// give a tree that is cheaper to trace. 0 threads builds it on every hardware thread
+	int _bvhSplitBins = 16;
+	int _bvhBuildThreads = 0;
+
+	// All random numbers are derived from this, the same seed gives the same image
+	uint64_t _seed = 0;
+	SamplerType _samplerType = SamplerType::SOBOL;
 };
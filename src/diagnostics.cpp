@@ -0,0 +1,107 @@
+#include "diagnostics.hpp"
+
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	using Counts = std::array<uint64_t, static_cast<size_t>(Diagnostic::COUNT)>;
+
+	// The counters of the live threads, what exited threads counted and the totals
+	// at the last reset. Only touched when a thread starts or exits and when reading
+	struct Registry
+	{
+		std::mutex _mutex;
+		std::vector<const std::array<std::atomic<uint64_t>, static_cast<size_t>(Diagnostic::COUNT)>*> _live;
+		Counts _retired{};
+		Counts _baseline{};
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	// Needs the registry lock
+	Counts sumLocked(const Registry& reg)
+	{
+		Counts sum = reg._retired;
+		for (const auto* counts : reg._live)
+			for (size_t i = 0; i < sum.size(); ++i)
+				sum[i] += (*counts)[i].load(std::memory_order_relaxed);
+		return sum;
+	}
+}
+
+Diagnostics::ThreadCounters::ThreadCounters()
+{
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock{ reg._mutex };
+	reg._live.push_back(&_counts);
+}
+
+Diagnostics::ThreadCounters::~ThreadCounters()
+{
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock{ reg._mutex };
+	for (size_t i = 0; i < _counts.size(); ++i)
+		reg._retired[i] += _counts[i].load(std::memory_order_relaxed);
+	reg._live.erase(std::find(reg._live.begin(), reg._live.end(), &_counts));
+}
+
+uint64_t Diagnostics::total(Diagnostic diagnostic)
+{
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock{ reg._mutex };
+	const size_t i = static_cast<size_t>(diagnostic);
+	return sumLocked(reg)[i] - reg._baseline[i];
+}
+
+void Diagnostics::reset()
+{
+	// The counters keep running, the totals are taken relative to this point
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock{ reg._mutex };
+	reg._baseline = sumLocked(reg);
+}
+
+void Diagnostics::print()
+{
+	Counts counts;
+	{
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> lock{ reg._mutex };
+		counts = sumLocked(reg);
+		for (size_t i = 0; i < counts.size(); ++i)
+			counts[i] -= reg._baseline[i];
+	}
+
+	if (std::all_of(counts.begin(), counts.end(), [](uint64_t count) { return count == 0; }))
+		return;
+
+	std::cout << "Diagnostics:\n";
+	for (size_t i = 0; i < counts.size(); ++i)
+	{
+		if (counts[i] > 0)
+			std::cout << "  " << name(static_cast<Diagnostic>(i)) << ": " << counts[i] << "\n";
+	}
+	std::cout << "\n";
+}
+
+const char* Diagnostics::name(Diagnostic diagnostic)
+{
+	switch (diagnostic)
+	{
+	case Diagnostic::ESCAPED_RAY: return "rays with no intersections";
+	case Diagnostic::NAN_THROUGHPUT: return "NaN path throughputs";
+	case Diagnostic::INVALID_DIVISION: return "divisions with an inf or NaN result";
+	case Diagnostic::ZERO_LIGHT_DISTANCE: return "shadow rays starting on the light";
+	case Diagnostic::PATH_RAY_CAP: return "samples that hit the ray cap";
+	case Diagnostic::PENDING_STACK_FULL: return "glass splits with a full pending stack";
+	case Diagnostic::COUNT: break;
+	}
+	return "unknown";
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Things that should not happen, but do now and then deep inside the integrator
+enum class Diagnostic
+{
+	// A ray that left the scene without hitting anything
+	ESCAPED_RAY,
+	// A path throughput that turned into NaN
+	NAN_THROUGHPUT,
+	// safeDivide still ended up with an infinite or NaN component
+	INVALID_DIVISION,
+	// A shadow ray that starts on the light itself
+	ZERO_LIGHT_DISTANCE,
+	// A camera sample that ran out of rays before all of its branches ended
+	PATH_RAY_CAP,
+	// A glass split with no room left on the pending stack, only one branch was followed
+	PENDING_STACK_FULL,
+	COUNT
+};
+
+// Counts diagnostics per thread without any locking, counting one only costs a
+// thread local increment. The counts of all threads, including the ones that
+// have already exited, are only added up when they are read
+class Diagnostics
+{
+public:
+	static void count(Diagnostic diagnostic)
+	{
+		// Only the owning thread writes, a plain load and store is enough to be read safely
+		std::atomic<uint64_t>& counter = localCounters()._counts[static_cast<size_t>(diagnostic)];
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// The count since the last reset, over all threads
+	static uint64_t total(Diagnostic diagnostic);
+	// Starts counting from zero again
+	static void reset();
+	// Prints the counters that are not zero, nothing if they all are
+	static void print();
+
+	static const char* name(Diagnostic diagnostic);
+
+private:
+	struct ThreadCounters
+	{
+		ThreadCounters();
+		~ThreadCounters();
+
+		std::array<std::atomic<uint64_t>, static_cast<size_t>(Diagnostic::COUNT)> _counts{};
+	};
+
+	static ThreadCounters& localCounters()
+	{
+		thread_local ThreadCounters counters;
+		return counters;
+	}
+};
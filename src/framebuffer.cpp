@@ -0,0 +1,234 @@
+#include "framebuffer.hpp"
+
+#include <iostream>
+#include <glm/glm.hpp>
+#include <glm/gtx/string_cast.hpp>
+
+#include "lodepng.h"
+#include "util.hpp"
+
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+FrameBuffer::FrameBuffer(int width, int height)
+	: _width{ width }, _height{ height },
+	  _red(static_cast<size_t>(width) * height, 0.0),
+	  _green(static_cast<size_t>(width) * height, 0.0),
+	  _blue(static_cast<size_t>(width) * height, 0.0),
+	  _sampleCount(static_cast<size_t>(width) * height, 0u),
+	  _luminanceMean(static_cast<size_t>(width) * height, 0.0),
+	  _luminanceM2(static_cast<size_t>(width) * height, 0.0)
+{
+}
+
+double FrameBuffer::getStandardError(size_t index) const
+{
+	const uint32_t n = _sampleCount[index];
+	if (n < 2)
+		return std::numeric_limits<double>::infinity();
+
+	const double variance = _luminanceM2[index] / (n - 1);
+	return std::sqrt(variance / n);
+}
+
+void FrameBuffer::resolve()
+{
+	const size_t n = size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const double invCount = _sampleCount[i] == 0 ? 0.0 : 1.0 / _sampleCount[i];
+		_red[i] *= invCount;
+		_green[i] *= invCount;
+		_blue[i] *= invCount;
+		_sampleCount[i] = _sampleCount[i] == 0 ? 0u : 1u;
+	}
+}
+
+size_t FrameBuffer::totalSamples() const
+{
+	return std::accumulate(_sampleCount.begin(), _sampleCount.end(), size_t{ 0 });
+}
+
+void FrameBuffer::merge(const FrameBuffer& other)
+{
+	const size_t n = size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const uint32_t countA = _sampleCount[i];
+		const uint32_t countB = other._sampleCount[i];
+		if (countB == 0)
+			continue;
+
+		// Chan et al.'s pairwise combination of the Welford statistics
+		const double total = static_cast<double>(countA) + countB;
+		const double delta = other._luminanceMean[i] - _luminanceMean[i];
+		_luminanceMean[i] += delta * countB / total;
+		_luminanceM2[i] += other._luminanceM2[i] + delta * delta * countA * countB / total;
+
+		_red[i] += other._red[i];
+		_green[i] += other._green[i];
+		_blue[i] += other._blue[i];
+		_sampleCount[i] = countA + countB;
+	}
+}
+
+void FrameBuffer::copyRegion(const FrameBuffer& source, const Tile& region)
+{
+	const Tile tile = region.clampedTo(_width, _height);
+	for (int row = tile.y0; row < tile.y1; ++row)
+	{
+		const size_t begin = pixelIndex(row, tile.x0);
+		const size_t end = pixelIndex(row, tile.x1);
+		std::copy(source._red.begin() + begin, source._red.begin() + end, _red.begin() + begin);
+		std::copy(source._green.begin() + begin, source._green.begin() + end, _green.begin() + begin);
+		std::copy(source._blue.begin() + begin, source._blue.begin() + end, _blue.begin() + begin);
+		std::copy(source._sampleCount.begin() + begin, source._sampleCount.begin() + end, _sampleCount.begin() + begin);
+		std::copy(source._luminanceMean.begin() + begin, source._luminanceMean.begin() + end, _luminanceMean.begin() + begin);
+		std::copy(source._luminanceM2.begin() + begin, source._luminanceM2.begin() + end, _luminanceM2.begin() + begin);
+	}
+}
+
+void FrameBuffer::clearRegion(const Tile& region)
+{
+	const Tile tile = region.clampedTo(_width, _height);
+	for (int row = tile.y0; row < tile.y1; ++row)
+	{
+		const size_t begin = pixelIndex(row, tile.x0);
+		const size_t end = pixelIndex(row, tile.x1);
+		std::fill(_red.begin() + begin, _red.begin() + end, 0.0);
+		std::fill(_green.begin() + begin, _green.begin() + end, 0.0);
+		std::fill(_blue.begin() + begin, _blue.begin() + end, 0.0);
+		std::fill(_sampleCount.begin() + begin, _sampleCount.begin() + end, 0u);
+		std::fill(_luminanceMean.begin() + begin, _luminanceMean.begin() + end, 0.0);
+		std::fill(_luminanceM2.begin() + begin, _luminanceM2.begin() + end, 0.0);
+	}
+}
+
+namespace
+{
+	template<typename T>
+	void writeChannel(std::ostream& stream, const AlignedVector<T>& channel)
+	{
+		stream.write(reinterpret_cast<const char*>(channel.data()), channel.size() * sizeof(T));
+	}
+
+	template<typename T>
+	void readChannel(std::istream& stream, AlignedVector<T>& channel)
+	{
+		stream.read(reinterpret_cast<char*>(channel.data()), channel.size() * sizeof(T));
+	}
+}
+
+void FrameBuffer::write(std::ostream& stream) const
+{
+	writeChannel(stream, _red);
+	writeChannel(stream, _green);
+	writeChannel(stream, _blue);
+	writeChannel(stream, _sampleCount);
+	writeChannel(stream, _luminanceMean);
+	writeChannel(stream, _luminanceM2);
+}
+
+bool FrameBuffer::read(std::istream& stream)
+{
+	readChannel(stream, _red);
+	readChannel(stream, _green);
+	readChannel(stream, _blue);
+	readChannel(stream, _sampleCount);
+	readChannel(stream, _luminanceMean);
+	readChannel(stream, _luminanceM2);
+	return static_cast<bool>(stream);
+}
+
+void FrameBuffer::sqrtAllPixels()
+{
+	const size_t n = size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Color color = getColor(i);
+		if (someComponent(color, static_cast<bool(*)(double)>(&std::isnan)) ||
+			someComponent(color, static_cast<bool(*)(double)>(&std::isinf)) ||
+			someComponent(color, [](double val) { return val < 0; }))
+		{
+			std::cout << "Problem pixel detected, value: " << glm::to_string(color) << "\n";
+		}
+	}
+
+	for (double* channel : { _red.data(), _green.data(), _blue.data() })
+		for (size_t i = 0; i < n; ++i)
+			channel[i] = std::sqrt(std::max(channel[i], 0.0));
+}
+
+void FrameBuffer::limitRange(double upperBound)
+{
+	const size_t n = size();
+	for (double* channel : { _red.data(), _green.data(), _blue.data() })
+		for (size_t i = 0; i < n; ++i)
+			channel[i] = std::min(std::max(channel[i], 0.0), upperBound);
+}
+
+void FrameBuffer::normalize()
+{
+	const double maxIntensity = findMaxIntensity();
+
+	const size_t n = size();
+	for (double* channel : { _red.data(), _green.data(), _blue.data() })
+		for (size_t i = 0; i < n; ++i)
+			channel[i] /= maxIntensity;
+}
+
+double FrameBuffer::findMaxIntensity() const
+{
+	const size_t n = size();
+	const double* red = _red.data();
+	const double* green = _green.data();
+	const double* blue = _blue.data();
+
+	double maxIntensity = 0.0;
+	for (size_t i = 0; i < n; ++i)
+		maxIntensity = std::max(maxIntensity, std::max(std::max(red[i], green[i]), blue[i]));
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Color color = getColor(i);
+		if (someComponent(color, static_cast<bool(*)(double)>(&std::isnan)))
+			std::cout << "Pixel with NaN detected, value: " << glm::to_string(color) << "\n";
+	}
+
+	return maxIntensity;
+}
+
+void FrameBuffer::createPNG(const std::string& file)
+{
+	const double maxIntensity = findMaxIntensity();
+
+	std::cout << "Maximum intensity found: " << maxIntensity << '\n';
+	std::cout << "Start writing to file...\n";
+	
+	std::vector<unsigned char> image;
+	image.resize(size() * 4);
+
+	for (int row = 0; row < _height; ++row)
+	{
+		for (int col = 0; col < _width; col++)
+		{
+			const size_t index = pixelIndex(row, col);
+			unsigned char r = static_cast<unsigned char>(_red[index] * 255.99f / maxIntensity);
+			unsigned char g = static_cast<unsigned char>(_green[index] * 255.99f / maxIntensity);
+			unsigned char b = static_cast<unsigned char>(_blue[index] * 255.99f / maxIntensity);
+
+			image[(_height - 1 - row) * 4 * _width + (_width - 1 - col) * 4 + 0] = r;
+			image[(_height - 1 - row) * 4 * _width + (_width - 1 - col) * 4 + 1] = g;
+			image[(_height - 1 - row) * 4 * _width + (_width - 1 - col) * 4 + 2] = b;
+			image[(_height - 1 - row) * 4 * _width + (_width - 1 - col) * 4 + 3] = 255;
+		}
+	}
+
+	unsigned error = lodepng::encode(file, image, _width, _height);
+	if (error) std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+	else std::cout << "Done!\n";
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <iosfwd>
+#include <string>
+
+#include "basic_types.hpp"
+#include "tile.hpp"
+
+// Where limitRange cuts off the resolved radiance before normalizing, for the
+// renderer and for merged shards alike so their images match
+constexpr double DISPLAY_RANGE_LIMIT = 1.4;
+
+// Minimal allocator that hands out memory aligned to Alignment bytes,
+// so that the framebuffer channels start on a cache line
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template<typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Alignment }));
+	}
+	void deallocate(T* p, size_t)
+	{
+		::operator delete(p, std::align_val_t{ Alignment });
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Row-major accumulation buffer stored as structure of arrays, one contiguous
+// channel each for the red, green and blue sums and one for the sample counts.
+// Pixels are addressed by their flat index row * width + col.
+// The running mean and variance of each pixel's luminance is tracked as well
+// (Welford's algorithm), it drives the adaptive sampling.
+class FrameBuffer
+{
+public:
+	FrameBuffer(int width, int height);
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+	size_t size() const { return _sampleCount.size(); }
+	size_t pixelIndex(int row, int col) const { return static_cast<size_t>(row) * _width + col; }
+
+	void addSample(size_t index, const Color& color)
+	{
+		_red[index] += color.r;
+		_green[index] += color.g;
+		_blue[index] += color.b;
+		const uint32_t n = ++_sampleCount[index];
+
+		const double luminance = 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
+		const double delta = luminance - _luminanceMean[index];
+		_luminanceMean[index] += delta / n;
+		_luminanceM2[index] += delta * (luminance - _luminanceMean[index]);
+	}
+
+	Color getColor(size_t index) const { return Color{ _red[index], _green[index], _blue[index] }; }
+	void setColor(size_t index, const Color& color)
+	{
+		_red[index] = color.r;
+		_green[index] = color.g;
+		_blue[index] = color.b;
+	}
+	uint32_t getSampleCount(size_t index) const { return _sampleCount[index]; }
+
+	double getLuminanceMean(size_t index) const { return _luminanceMean[index]; }
+	// Standard error of the luminance mean, infinite until there are two samples
+	double getStandardError(size_t index) const;
+
+	double* red() { return _red.data(); }
+	double* green() { return _green.data(); }
+	double* blue() { return _blue.data(); }
+	const double* red() const { return _red.data(); }
+	const double* green() const { return _green.data(); }
+	const double* blue() const { return _blue.data(); }
+	const uint32_t* sampleCounts() const { return _sampleCount.data(); }
+	size_t totalSamples() const;
+
+	// Adds the samples of other, which must have the same size, as if they had been taken here
+	void merge(const FrameBuffer& other);
+
+	// Copies every channel of the pixels inside region from source, which must have the same size.
+	// Both region functions ignore the parts of it outside the image
+	void copyRegion(const FrameBuffer& source, const Tile& region);
+	// Drops every sample taken for the pixels inside region
+	void clearRegion(const Tile& region);
+
+	// Raw binary dump of the channels, the size is not included
+	void write(std::ostream& stream) const;
+	bool read(std::istream& stream);
+
+	// Divides every sum by its sample count, the buffer then holds the
+	// mean color of each pixel and every count is 1
+	void resolve();
+
+	// Post processing and output of a resolved buffer
+	void limitRange(double upperBound);
+	void normalize();
+	void sqrtAllPixels();
+	double findMaxIntensity() const;
+	void createPNG(const std::string& file);
+
+private:
+	int _width;
+	int _height;
+
+	AlignedVector<double> _red;
+	AlignedVector<double> _green;
+	AlignedVector<double> _blue;
+	AlignedVector<uint32_t> _sampleCount;
+	AlignedVector<double> _luminanceMean;
+	AlignedVector<double> _luminanceM2;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "config.hpp"
+
+// The config settings the integrator inner loops depend on, fixed at compile time.
+// Every combination is an instantiation of its own, picked once when the render
+// starts, so the loops are left without config lookups and the constants fold
+template<bool PhotonMapping, int ShadowRays>
+struct KernelSettings
+{
+	static constexpr bool usePhotonMapping = PhotonMapping;
+	// Shadow ray counts without an instantiation of their own are read from the config (0)
+	static int numShadowRays()
+	{
+		return ShadowRays > 0 ? ShadowRays : Config::numShadowRaysPerIntersection();
+	}
+};
+
+// Calls X(photonMapping, shadowRays) for every instantiated combination
+#define FOR_EACH_KERNEL_SETTINGS(X) \
+	X(false, 1) X(false, 2) X(false, 4) X(false, 0) \
+	X(true, 1) X(true, 2) X(true, 4) X(true, 0)
+
+namespace kernel_detail
+{
+	template<bool PhotonMapping, typename Function>
+	decltype(auto) withShadowRays(Function&& function)
+	{
+		switch (Config::numShadowRaysPerIntersection())
+		{
+		case 1: return function(KernelSettings<PhotonMapping, 1>{});
+		case 2: return function(KernelSettings<PhotonMapping, 2>{});
+		case 4: return function(KernelSettings<PhotonMapping, 4>{});
+		default: return function(KernelSettings<PhotonMapping, 0>{});
+		}
+	}
+}
+
+// Calls function with the KernelSettings matching the current config
+template<typename Function>
+decltype(auto) withKernelSettings(Function&& function)
+{
+	if (Config::usePhotonMapping())
+		return kernel_detail::withShadowRays<true>(function);
+	return kernel_detail::withShadowRays<false>(function);
+}
@@ -2,26 +2,160 @@
 #include <chrono>
 #include <ctime>
 #include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
 
 #include "scene.hpp"
 #include "camera.hpp"
 #include "config.hpp"
 #include "util.hpp"
 
-int main()
+namespace
+{
+	void printUsage(const char* program)
+	{
+		std::cout << "Usage: " << program << " [--checkpoint <file>] [--checkpoint-interval <seconds>] [--resume <file>]\n"
+			<< "\t[--crop <x0> <y0> <x1> <y1>] [--composite <file>]\n"
+			<< "\t[--shard-region <x0> <y0> <x1> <y1>] [--sample-range <first> <count>] [--interleave <index> <count>]\n";
+	}
+}
+
+int main(int argc, char* argv[])
 {
 	auto& config = Config::instance();
 	config.setResolution(200);
 	config.setSamplesPerPixel(100);
+	config.setTileSize(16);
+	config.setAdaptiveSampling(false);
+	config.setMinSamplesPerPixel(16);
+	config.setMaxSamplesPerPixel(400);
+	config.setAdaptiveErrorThreshold(0.1);
+	config.setTimeBudget(0.0);
+	config.setSamplesPerPass(1);
 	config.setMonteCarloTerminationProbability(0.2f);
+	config.setRouletteMode(RouletteMode::THROUGHPUT);
+	config.setRouletteMinDepth(3);
+	config.setMaxDepths(16, 32, 32);
 	config.setNumShadowRaysPerIntersection(1);
 	config.setUsePhotonMapping(false);
+	config.setUseWavefront(false);
+	config.setPacketSize(8);
+	config.setSortSecondaryRays(false);
+	config.setBvhBuild(16, 0);
+	config.setSeed(0);
+	config.setSamplerType(SamplerType::SOBOL);
+	config.setCheckpointInterval(300.0);
+
+	// --checkpoint <file> saves the render progress to file every checkpoint interval,
+	// --resume <file> continues from such a file and keeps checkpointing to it.
+	// A shard of a distributed render is limited with --shard-region to a pixel rectangle,
+	// with --sample-range to a contiguous block of each pixel's samples or with --interleave
+	// to every count:th sample starting at index. Its final checkpoint is what MCMerge combines.
+	// --crop is the same as --shard-region, with --composite <file> the crop window is
+	// rerendered on top of the accumulation file of an earlier render and saved back into it
+	std::string resumeFile;
+	std::string compositeFile;
+	bool sampleShard = false;
+	// std::stoi and std::stod throw on arguments that are not numbers or do not fit
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (arg == "--checkpoint" && i + 1 < argc)
+				config.setCheckpointFile(argv[++i]);
+			else if (arg == "--checkpoint-interval" && i + 1 < argc)
+				config.setCheckpointInterval(std::stod(argv[++i]));
+			else if (arg == "--resume" && i + 1 < argc)
+			{
+				resumeFile = argv[++i];
+				config.setCheckpointFile(resumeFile);
+			}
+			else if (arg == "--composite" && i + 1 < argc)
+			{
+				compositeFile = argv[++i];
+				config.setCheckpointFile(compositeFile);
+			}
+			else if ((arg == "--shard-region" || arg == "--crop") && i + 4 < argc)
+			{
+				Tile region;
+				region.x0 = std::stoi(argv[++i]);
+				region.y0 = std::stoi(argv[++i]);
+				region.x1 = std::stoi(argv[++i]);
+				region.y1 = std::stoi(argv[++i]);
+				const int resolution = Config::resolution();
+				if (region.x0 < 0 || region.y0 < 0 || region.x0 >= region.x1 || region.y0 >= region.y1 ||
+					region.x1 > resolution || region.y1 > resolution)
+				{
+					std::cout << "Invalid region " << region.x0 << " " << region.y0 << " " << region.x1 << " " << region.y1
+						<< ", it has to lie within the " << resolution << "x" << resolution << " image\n";
+					return 1;
+				}
+				config.setShardRegion(region);
+			}
+			else if (arg == "--sample-range" && i + 2 < argc)
+			{
+				int first = std::stoi(argv[++i]);
+				int count = std::stoi(argv[++i]);
+				if (first < 0 || count < 1)
+				{
+					std::cout << "Invalid sample range " << first << " " << count << "\n";
+					return 1;
+				}
+				config.setShardSampleRange(first, 1, count);
+				sampleShard = true;
+			}
+			else if (arg == "--interleave" && i + 2 < argc)
+			{
+				int index = std::stoi(argv[++i]);
+				int count = std::stoi(argv[++i]);
+				if (index < 0 || index >= std::min(count, Config::samplesPerPixel()))
+				{
+					std::cout << "Invalid interleave " << index << " " << count << "\n";
+					return 1;
+				}
+				config.setShardSampleRange(index, count, (Config::samplesPerPixel() - index + count - 1) / count);
+				sampleShard = true;
+			}
+			else
+			{
+				std::cout << "Unknown argument " << arg << "\n";
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+	}
+	catch (const std::logic_error&)
+	{
+		std::cout << "Invalid number in the arguments\n";
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	// Adaptive sampling decides per pixel how many samples to take, which can not be split up front
+	if (sampleShard && (Config::adaptiveSampling() || Config::timeBudget() > 0.0))
+	{
+		std::cout << "Sample range shards need a fixed number of samples per pixel\n";
+		return 1;
+	}
+
+	if (!resumeFile.empty() && !compositeFile.empty())
+	{
+		std::cout << "--resume and --composite can not be combined, resume the composite file instead\n";
+		return 1;
+	}
 
-	Scene scene{};
 	Camera testCamera;
+	if (!resumeFile.empty() && !testCamera.resumeFrom(resumeFile))
+		return 1;
+	if (!compositeFile.empty() && !testCamera.compositeOnto(compositeFile, Config::shardRegion()))
+		return 1;
+
+	Scene scene{};
 	auto duration = testCamera.render(scene);
 
-	testCamera.limitRange(1.4);
+	testCamera.limitRange(DISPLAY_RANGE_LIMIT);
 	testCamera.normalize();
 	testCamera.sqrtAllPixels();
 
@@ -30,7 +164,7 @@ int main()
 
 	// Save under unique name as well, to document progress
 	std::string filename = "Renders/MC_" + friendlyTimeStamp() + "_" +
-		std::to_string(Config::samplesPerPixel()) + "spp_" +
+		std::to_string(static_cast<int>(std::round(testCamera.averageSamplesPerPixel()))) + "spp_" +
 		friendlyDurationFormat(duration) + ".png";
 	testCamera.createPNG(filename);
 
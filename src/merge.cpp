@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "framebuffer.hpp"
+
+// Combines the final checkpoints of the shards of a distributed render into one image.
+// Region shards fill in their own pixels, sample range shards add their samples on top
+// of each other, so any mix of the two merges the same way.
+int main(int argc, char* argv[])
+{
+	std::string outputFile;
+	std::string accumulationFile;
+	std::vector<std::string> shardFiles;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--accumulation" && i + 1 < argc)
+			accumulationFile = argv[++i];
+		else if (outputFile.empty())
+			outputFile = arg;
+		else
+			shardFiles.push_back(arg);
+	}
+
+	if (outputFile.empty() || shardFiles.empty())
+	{
+		std::cout << "Usage: " << argv[0] << " <output.png> <shard checkpoint>... [--accumulation <file>]\n";
+		return 1;
+	}
+
+	CheckpointHeader mergedHeader;
+	FrameBuffer merged{ 0, 0 };
+	for (const std::string& file : shardFiles)
+	{
+		CheckpointHeader header;
+		FrameBuffer shard{ 0, 0 };
+		if (!readCheckpoint(file, header, shard))
+			return 1;
+
+		const size_t shardSamples = shard.totalSamples();
+		if (merged.size() == 0)
+		{
+			mergedHeader = header;
+			merged = std::move(shard);
+		}
+		else if (header.frameHash != mergedHeader.frameHash ||
+			shard.width() != merged.width() || shard.height() != merged.height())
+		{
+			std::cout << file << " belongs to a different frame than " << shardFiles.front() << "\n";
+			return 1;
+		}
+		else
+		{
+			merged.merge(shard);
+		}
+
+		std::cout << "Merged " << file << " with " << shardSamples << " samples\n";
+	}
+
+	std::cout << "Merged " << shardFiles.size() << " shards, "
+		<< static_cast<double>(merged.totalSamples()) / merged.size() << " spp on average\n";
+
+	// The merged file can not be resumed, but it can be merged again with more shards
+	if (!accumulationFile.empty())
+	{
+		mergedHeader.configHash = 0;
+		mergedHeader.completedTiles.clear();
+		if (!writeCheckpoint(accumulationFile, mergedHeader, merged))
+			return 1;
+	}
+
+	merged.resolve();
+	merged.limitRange(DISPLAY_RANGE_LIMIT);
+	merged.normalize();
+	merged.sqrtAllPixels();
+	merged.createPNG(outputFile);
+
+	return 0;
+}
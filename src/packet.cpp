@@ -0,0 +1,308 @@
+#include "packet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "simd.hpp"
+#include "scenegeometry.hpp"
+#include "raycastingfunctions.hpp"
+
+namespace
+{
+	constexpr size_t MAX_PACKET_CHUNKS = (MAX_PACKET_SIZE + SIMD_WIDTH - 1) / SIMD_WIDTH;
+
+	// The rays of a packet as structure of arrays, one FloatV per SIMD_WIDTH rays
+	struct PacketRays
+	{
+		FloatV _ox[MAX_PACKET_CHUNKS], _oy[MAX_PACKET_CHUNKS], _oz[MAX_PACKET_CHUNKS];
+		FloatV _dx[MAX_PACKET_CHUNKS], _dy[MAX_PACKET_CHUNKS], _dz[MAX_PACKET_CHUNKS];
+		FloatV _tMin[MAX_PACKET_CHUNKS];
+		// The closest hit so far and the owner of its primitive, -1 for none
+		FloatV _t[MAX_PACKET_CHUNKS];
+		FloatV _owner[MAX_PACKET_CHUNKS];
+		size_t _numChunks;
+	};
+
+	void loadPacket(const Ray* rays, size_t count, PacketRays& packet)
+	{
+		// The lanes after the last ray repeat the first one, they are computed but never read
+		alignas(32) float lanes[8][MAX_PACKET_CHUNKS * SIMD_WIDTH];
+		packet._numChunks = (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+		for (size_t i = 0; i < packet._numChunks * SIMD_WIDTH; ++i)
+		{
+			const Ray& ray = rays[i < count ? i : 0];
+			lanes[0][i] = ray._origin.x;
+			lanes[1][i] = ray._origin.y;
+			lanes[2][i] = ray._origin.z;
+			lanes[3][i] = ray._direction.x;
+			lanes[4][i] = ray._direction.y;
+			lanes[5][i] = ray._direction.z;
+			lanes[6][i] = ray._tMax;
+			lanes[7][i] = ray._tMin;
+		}
+
+		for (size_t chunk = 0; chunk < packet._numChunks; ++chunk)
+		{
+			const size_t first = chunk * SIMD_WIDTH;
+			packet._ox[chunk] = FloatV::load(&lanes[0][first]);
+			packet._oy[chunk] = FloatV::load(&lanes[1][first]);
+			packet._oz[chunk] = FloatV::load(&lanes[2][first]);
+			packet._dx[chunk] = FloatV::load(&lanes[3][first]);
+			packet._dy[chunk] = FloatV::load(&lanes[4][first]);
+			packet._dz[chunk] = FloatV::load(&lanes[5][first]);
+			packet._t[chunk] = FloatV::load(&lanes[6][first]);
+			packet._tMin[chunk] = FloatV::load(&lanes[7][first]);
+			packet._owner[chunk] = FloatV{ -1.0f };
+		}
+	}
+
+	// Moller Trumbore for SIMD_WIDTH rays against one triangle, the same steps as Triangle::rayIntersection
+	void intersectTriangle(PacketRays& packet, size_t chunk, const glm::vec3& corner,
+		const glm::vec3& edge1, const glm::vec3& edge2, FloatV owner)
+	{
+		const FloatV& dx = packet._dx[chunk];
+		const FloatV& dy = packet._dy[chunk];
+		const FloatV& dz = packet._dz[chunk];
+		const FloatV e1x{ edge1.x }, e1y{ edge1.y }, e1z{ edge1.z };
+		const FloatV e2x{ edge2.x }, e2y{ edge2.y }, e2z{ edge2.z };
+
+		const FloatV tx = packet._ox[chunk] - FloatV{ corner.x };
+		const FloatV ty = packet._oy[chunk] - FloatV{ corner.y };
+		const FloatV tz = packet._oz[chunk] - FloatV{ corner.z };
+
+		const FloatV px = dy * e2z - dz * e2y;
+		const FloatV py = dz * e2x - dx * e2z;
+		const FloatV pz = dx * e2y - dy * e2x;
+		const FloatV qx = ty * e1z - tz * e1y;
+		const FloatV qy = tz * e1x - tx * e1z;
+		const FloatV qz = tx * e1y - ty * e1x;
+
+		const FloatV factor = FloatV{ 1.0f } / (px * e1x + py * e1y + pz * e1z);
+		const FloatV t = factor * (qx * e2x + qy * e2y + qz * e2z);
+		const FloatV u = factor * (px * tx + py * ty + pz * tz);
+		const FloatV v = factor * (qx * dx + qy * dy + qz * dz);
+
+		const FloatV zero{ 0.0f };
+		const FloatV hit = (u >= zero) & (v >= zero) & (u + v <= FloatV{ 1.0f }) &
+			(t > packet._tMin[chunk]) & (t < packet._t[chunk]);
+		packet._t[chunk] = select(hit, t, packet._t[chunk]);
+		packet._owner[chunk] = select(hit, owner, packet._owner[chunk]);
+	}
+
+	// The same choice of root as Sphere::rayIntersection, the far one if the ray starts inside
+	void intersectSphere(PacketRays& packet, size_t chunk, const glm::vec3& center, float radiusSquared, FloatV owner)
+	{
+		const FloatV& dx = packet._dx[chunk];
+		const FloatV& dy = packet._dy[chunk];
+		const FloatV& dz = packet._dz[chunk];
+		const FloatV ocx = packet._ox[chunk] - FloatV{ center.x };
+		const FloatV ocy = packet._oy[chunk] - FloatV{ center.y };
+		const FloatV ocz = packet._oz[chunk] - FloatV{ center.z };
+
+		const FloatV a = dx * dx + dy * dy + dz * dz;
+		const FloatV halfB = ocx * dx + ocy * dy + ocz * dz;
+		const FloatV c = ocx * ocx + ocy * ocy + ocz * ocz - FloatV{ radiusSquared };
+		const FloatV discriminant = halfB * halfB - a * c;
+
+		const FloatV zero{ 0.0f };
+		const FloatV root = sqrt(select(discriminant >= zero, discriminant, zero));
+		const FloatV nearD = zero - halfB - root;
+		const FloatV farD = zero - halfB + root;
+		const FloatV& tMin = packet._tMin[chunk];
+		const FloatV d = select((nearD < tMin) & (farD > tMin), farD, nearD);
+
+		const FloatV hit = (discriminant >= zero) & (d >= tMin) & (d < packet._t[chunk]);
+		packet._t[chunk] = select(hit, d, packet._t[chunk]);
+		packet._owner[chunk] = select(hit, owner, packet._owner[chunk]);
+	}
+}
+
+PacketGeometry::PacketGeometry(const SceneGeometry& geometry)
+	: _geometry{ &geometry }
+{
+	const size_t numObjects = geometry._sceneTris.size() + geometry._tetrahedrons.size() +
+		geometry._spheres.size() + geometry._ceilingLights.size();
+	if (numObjects > MAX_FLAT_OBJECTS)
+		return;
+
+	for (const TriangleObj& triangle : geometry._sceneTris)
+	{
+		_owners.push_back(Owner{ TRIANGLE_OBJ, &triangle });
+		addTriangle(triangle.getTriangle(), static_cast<uint32_t>(_owners.size() - 1));
+	}
+
+	for (const Tetrahedron& tetrahedron : geometry._tetrahedrons)
+	{
+		_owners.push_back(Owner{ TETRAHEDRON, &tetrahedron });
+		for (const Triangle& triangle : tetrahedron.getTriangles())
+			addTriangle(triangle, static_cast<uint32_t>(_owners.size() - 1));
+	}
+
+	for (const Sphere& sphere : geometry._spheres)
+	{
+		_owners.push_back(Owner{ SPHERE, &sphere });
+		Primitive primitive{};
+		primitive._isSphere = true;
+		primitive._v0 = glm::vec3{ sphere.getPosition() };
+		primitive._radiusSquared = sphere.getRadius() * sphere.getRadius();
+		primitive._owner = static_cast<uint32_t>(_owners.size() - 1);
+		primitive._boundsCenter = primitive._v0;
+		primitive._boundsRadius = sphere.getRadius();
+		_primitives.push_back(primitive);
+	}
+
+	for (const CeilingLight& light : geometry._ceilingLights)
+	{
+		_owners.push_back(Owner{ CEILING_LIGHT, &light });
+		for (const TriangleObj& triangle : light.getTriangles())
+			addTriangle(triangle.getTriangle(), static_cast<uint32_t>(_owners.size() - 1));
+	}
+}
+
+void PacketGeometry::addTriangle(const Triangle& triangle, uint32_t owner)
+{
+	Primitive primitive{};
+	primitive._isSphere = false;
+	primitive._v0 = glm::vec3{ triangle.getVertex(0) };
+	primitive._e1 = glm::vec3{ triangle.getVertex(1) } - primitive._v0;
+	primitive._e2 = glm::vec3{ triangle.getVertex(2) } - primitive._v0;
+	primitive._owner = owner;
+
+	primitive._boundsCenter = glm::vec3{ triangle.getCenter() };
+	for (int i = 0; i < 3; ++i)
+	{
+		primitive._boundsRadius = std::max(primitive._boundsRadius,
+			glm::length(glm::vec3{ triangle.getVertex(i) } - primitive._boundsCenter));
+	}
+	_primitives.push_back(primitive);
+}
+
+void PacketGeometry::intersect(const Ray* rays, size_t count, std::optional<IntersectionSurface>* hits) const
+{
+	Frustum frustum;
+	if (_primitives.empty() || !packetFrustum(rays, count, frustum))
+	{
+		for (size_t i = 0; i < count; ++i)
+			hits[i] = rayIntersection(rays[i], *_geometry);
+		return;
+	}
+
+	PacketRays packet;
+	loadPacket(rays, count, packet);
+
+	for (const Primitive& primitive : _primitives)
+	{
+		if (!frustum.overlaps(primitive))
+			continue;
+
+		const FloatV owner{ static_cast<float>(primitive._owner) };
+		for (size_t chunk = 0; chunk < packet._numChunks; ++chunk)
+		{
+			if (primitive._isSphere)
+				intersectSphere(packet, chunk, primitive._v0, primitive._radiusSquared, owner);
+			else
+				intersectTriangle(packet, chunk, primitive._v0, primitive._e1, primitive._e2, owner);
+		}
+	}
+
+	alignas(32) float owners[MAX_PACKET_CHUNKS * SIMD_WIDTH];
+	for (size_t chunk = 0; chunk < packet._numChunks; ++chunk)
+		packet._owner[chunk].store(&owners[chunk * SIMD_WIDTH]);
+
+	// The packet only picks the object, its own intersection gives the exact point and
+	// normal. Should single precision disagree with it, the ray is traced on its own
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::optional<IntersectionData> data;
+		if (owners[i] >= 0.0f)
+			data = ownerIntersection(static_cast<uint32_t>(owners[i]), rays[i]);
+
+		if (data && data->_t < rays[i]._tMax)
+			hits[i] = IntersectionSurface{ *data, _owners[static_cast<uint32_t>(owners[i])]._object };
+		else
+			hits[i] = rayIntersection(rays[i], *_geometry);
+	}
+}
+
+bool PacketGeometry::packetFrustum(const Ray* rays, size_t count, Frustum& frustum)
+{
+	// The main axis is the one the first ray moves fastest along, every ray has to
+	// move forward along it for the slopes against it to bound the packet
+	const glm::vec3& first = rays[0]._direction;
+	const glm::vec3 magnitude = glm::abs(first);
+	const int axis = magnitude.x >= magnitude.y ? (magnitude.x >= magnitude.z ? 0 : 2) : (magnitude.y >= magnitude.z ? 1 : 2);
+	const int axisU = (axis + 1) % 3;
+	const int axisV = (axis + 2) % 3;
+	const float sign = first[axis] > 0.0f ? 1.0f : -1.0f;
+
+	float minU = std::numeric_limits<float>::infinity(), maxU = -minU;
+	float minV = minU, maxV = -minU;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (rays[i]._origin != rays[0]._origin)
+			return false;
+
+		const float forward = sign * rays[i]._direction[axis];
+		if (!(forward > 0.0f))
+			return false;
+
+		const float slopeU = rays[i]._direction[axisU] / forward;
+		const float slopeV = rays[i]._direction[axisV] / forward;
+		minU = std::min(minU, slopeU);
+		maxU = std::max(maxU, slopeU);
+		minV = std::min(minV, slopeV);
+		maxV = std::max(maxV, slopeV);
+	}
+
+	// A point p relative to the origin is inside if p[axisU] / (sign * p[axis]) lies
+	// between minU and maxU, the same for v, and it is in front of the origin
+	auto plane = [&](int slopeAxis, float slope, float orientation)
+	{
+		glm::vec3 normal{ 0.0f };
+		normal[slopeAxis] = orientation;
+		normal[axis] = -orientation * slope * sign;
+		return glm::normalize(normal);
+	};
+
+	glm::vec3 front{ 0.0f };
+	front[axis] = sign;
+
+	frustum._origin = rays[0]._origin;
+	frustum._normals = {
+		plane(axisU, minU, 1.0f),
+		plane(axisU, maxU, -1.0f),
+		plane(axisV, minV, 1.0f),
+		plane(axisV, maxV, -1.0f),
+		front
+	};
+	return true;
+}
+
+bool PacketGeometry::Frustum::overlaps(const Primitive& primitive) const
+{
+	const glm::vec3 center = primitive._boundsCenter - _origin;
+	for (const glm::vec3& normal : _normals)
+	{
+		if (glm::dot(normal, center) < -primitive._boundsRadius)
+			return false;
+	}
+	return true;
+}
+
+std::optional<IntersectionData> PacketGeometry::ownerIntersection(uint32_t owner, const Ray& ray) const
+{
+	const Owner& object = _owners[owner];
+	switch (object._type)
+	{
+	case TRIANGLE_OBJ:
+		return static_cast<const TriangleObj*>(object._object)->rayIntersection(ray);
+	case TETRAHEDRON:
+		return static_cast<const Tetrahedron*>(object._object)->rayIntersection(ray);
+	case SPHERE:
+		return static_cast<const Sphere*>(object._object)->rayIntersection(ray);
+	case CEILING_LIGHT:
+		return static_cast<const CeilingLight*>(object._object)->rayIntersection(ray);
+	}
+	return {};
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <optional>
+#include <cstdint>
+
+#include "basic_types.hpp"
+#include "ray.hpp"
+#include "shapes.hpp"
+
+class SceneGeometry;
+
+// The largest packet PacketGeometry::intersect takes
+constexpr size_t MAX_PACKET_SIZE = 16;
+
+// The scene flattened for tracing bundles of rays together. The camera rays of
+// neighbouring pixels start at the eye and point almost the same way, so they
+// mostly hit the same primitives. Every primitive is tested against SIMD_WIDTH
+// rays at once, and the ones outside the frustum spanned by the packet are
+// skipped altogether. A packet without a common origin and main direction has
+// no useful frustum, its rays are traced one at a time instead. So are all rays
+// of scenes too large to test flat, the BVH does better there.
+class PacketGeometry
+{
+public:
+	explicit PacketGeometry(const SceneGeometry& geometry);
+
+	// Fills hits with what rayIntersection finds for each of the count rays,
+	// count is at most MAX_PACKET_SIZE
+	void intersect(const Ray* rays, size_t count, std::optional<IntersectionSurface>* hits) const;
+
+private:
+	enum OwnerType : uint8_t
+	{
+		TRIANGLE_OBJ,
+		TETRAHEDRON,
+		SPHERE,
+		CEILING_LIGHT
+	};
+
+	// The object a primitive belongs to, it computes the final hit the scalar way
+	struct Owner
+	{
+		OwnerType _type;
+		const SceneObject* _object;
+	};
+
+	struct Primitive
+	{
+		bool _isSphere;
+		// A corner and the two edges from it, for spheres _v0 is the center
+		glm::vec3 _v0;
+		glm::vec3 _e1;
+		glm::vec3 _e2;
+		float _radiusSquared;
+		uint32_t _owner;
+
+		// Tested against the frustum of the packet
+		glm::vec3 _boundsCenter;
+		float _boundsRadius;
+	};
+
+	// Bounded by the planes through the common origin of the rays, a point is
+	// inside if it is on the positive side of all of them
+	struct Frustum
+	{
+		glm::vec3 _origin;
+		std::array<glm::vec3, 5> _normals;
+
+		bool overlaps(const Primitive& primitive) const;
+	};
+
+	// Above this many objects the rays go through the BVH
+	static constexpr size_t MAX_FLAT_OBJECTS = 128;
+
+	const SceneGeometry* _geometry;
+	std::vector<Owner> _owners;
+	// In the order the linear search visits them, so equally close hits resolve the same way.
+	// Empty if the scene is too large
+	std::vector<Primitive> _primitives;
+
+	void addTriangle(const Triangle& triangle, uint32_t owner);
+	// False if the rays diverge too much to share a frustum
+	static bool packetFrustum(const Ray* rays, size_t count, Frustum& frustum);
+	std::optional<IntersectionData> ownerIntersection(uint32_t owner, const Ray& ray) const;
+};
@@ -2,8 +2,9 @@
 #include "util.hpp"
 
 PhotonMap::PhotonMap(const SceneGeometry& geometry)
-	: _photonMap{}, _gen{ std::random_device{}() }, _rng{ 0.f, 1.f },
-	_deltaFlux{ calculateDeltaFlux() }
+	: _photonMap{},
+	_deltaFlux{ calculateDeltaFlux() },
+	_sampler{ Config::seed() ^ 0x9E3779B97F4A7C15ull } // Keep the photon streams apart from the camera streams
 {
 	auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -22,7 +23,8 @@ PhotonMap::PhotonMap(const SceneGeometry& geometry)
 	std::vector<std::thread> threads;
 	for (size_t i{ 0 }; i < numCores; i++)
 		threads.push_back(std::thread(
-			&PhotonMap::photonMapBuilderThreadFn, this, std::ref(geometry), std::ref(pVectors[i]), std::ref(spVectors[i]), PHOTONS_PER_THREAD));
+			&PhotonMap::photonMapBuilderThreadFn, this, std::ref(geometry), std::ref(pVectors[i]), std::ref(spVectors[i]),
+			i * PHOTONS_PER_THREAD, PHOTONS_PER_THREAD));
 	for (auto& thread : threads)
 		thread.join();
 
@@ -73,8 +75,9 @@ Radiance PhotonMap::getPhotonRadianceContrib(const Direction& incomingDir,
 	const SceneObject* const intersectObject, const IntersectionData& intersectionData)
 {
 	PhotonNode searchPosition{ intersectionData._intersectPoint };
-	std::vector<PhotonNode> photons;
-	photons.reserve(5u * N_PHOTONS_TO_CAST / 1000u);
+	// Every worker keeps its result buffer, it only grows until it fits the densest lookup
+	thread_local std::vector<PhotonNode> photons;
+	photons.clear();
 	getPhotons(photons, searchPosition);
 	//std::cout << photons.size() << '.. \n';
 
@@ -108,8 +111,9 @@ Radiance PhotonMap::getPhotonRadianceContrib(const Direction& incomingDir,
 }
 
 void PhotonMap::photonMapBuilderThreadFn(const SceneGeometry& geometry, std::vector<PhotonNode>& pMap,
-	std::vector<PhotonNode>& spMap, size_t photonsToCast)
+	std::vector<PhotonNode>& spMap, size_t firstPhoton, size_t photonsToCast)
 {
+
 	std::vector<CeilingLight> lights = geometry._ceilingLights;
 	for (const auto& light : lights)
 	{
@@ -122,55 +126,59 @@ void PhotonMap::photonMapBuilderThreadFn(const SceneGeometry& geometry, std::vec
 		for (size_t i = 0; i < photonsToCast; i++)
 		{
 			bool isEmittedByLight = true;
-			std::queue<Photon> photonQueue;
 
-			Photon initialPhoton = generateRandomPhotonFromLight(xCenter, yCenter);
-			photonQueue.push(std::move(initialPhoton));
+			// Everything a photon path allocates comes from the arena and is dropped here at once
+			ScratchArena& arena = ScratchArena::local();
+			arena.reset();
+			PhotonQueue photonQueue{ std::deque<Photon, ArenaAllocator<Photon>>{ arena } };
+			RandomStream random{ _sampler, static_cast<uint32_t>(firstPhoton + i), 0 };
+
+			photonQueue.push(generateRandomPhotonFromLight(xCenter, yCenter, random));
 
 			while(!photonQueue.empty())
 			{
-				std::vector<IntersectionSurface> pIntersects;
-				Photon currentP = std::move(photonQueue.front());
+				Photon currentP = photonQueue.front();
 				photonQueue.pop();
+				random.nextBounce();
 
-				photonIntersection(currentP, geometry, pIntersects);
+				std::optional<IntersectionSurface> pIntersect = photonIntersection(currentP._ray, geometry);
 
-				if (pIntersects.size() != 0)
+				if (pIntersect)
 				{
-					const unsigned pFirstIntersectSurfaceType = pIntersects[0].intersectionObject->getBRDF().getSurfaceType();
+					const unsigned pFirstIntersectSurfaceType = pIntersect->intersectionObject->getBRDF().getSurfaceType();
 					if (pFirstIntersectSurfaceType == BRDF::DIFFUSE)
 					{
-						Radiance pFlux = _deltaFlux * currentP.getColor();
-						addPhoton(PhotonNode{ pIntersects[0].intersectionData._intersectPoint, pFlux, currentP.getNormalizedDirection() },
+						Radiance pFlux = _deltaFlux * currentP._flux;
+						addPhoton(PhotonNode{ pIntersect->intersectionData._intersectPoint, pFlux, currentP._ray.getNormalizedDirection() },
 							photonData);
-						handleMonteCarloPhoton(photonQueue, pIntersects[0], currentP);
+						handleMonteCarloPhoton(photonQueue, *pIntersect, currentP, random);
 
 						if (isEmittedByLight)
-							addShadowPhotons(pIntersects, spMap);
+							addShadowPhotons(currentP._ray, pIntersect->intersectionData._t, geometry, spMap);
 					}
 					else if (pFirstIntersectSurfaceType == BRDF::REFLECTOR)
 					{
-						const IntersectionData tempInter = pIntersects[0].intersectionData;
-						Photon reflectedPhoton = computeReflectedRay(tempInter._normal, currentP, tempInter._intersectPoint);
-						reflectedPhoton.setColor(currentP.getColor()); //Radiance carries over
-						photonQueue.push(std::move(reflectedPhoton));
+						const IntersectionData tempInter = pIntersect->intersectionData;
+						Photon reflectedPhoton{ computeReflectedRay(tempInter._normal, currentP._ray, tempInter._intersectPoint) };
+						reflectedPhoton._flux = currentP._flux; //Radiance carries over
+						photonQueue.push(reflectedPhoton);
 
 						//std::cout << "reflection, i = " << i << ' ' << &currentP.getIntersectedObject()
 						//	<< tempInter._t << '\n';
 						if (isEmittedByLight)
-							addShadowPhotons(pIntersects, spMap);
+							addShadowPhotons(currentP._ray, pIntersect->intersectionData._t, geometry, spMap);
 					}
 					else if (pFirstIntersectSurfaceType == BRDF::TRANSPARENT)
 					{
-						const IntersectionData tempInter = pIntersects[0].intersectionData;
-						float incAngle = glm::angle(-currentP.getNormalizedDirection(), pIntersects[0].intersectionData._normal);
+						const IntersectionData tempInter = pIntersect->intersectionData;
+						float incAngle = glm::angle(-currentP._ray.getNormalizedDirection(), pIntersect->intersectionData._normal);
 						double reflectionCoeff, n1, n2;
-						bool rayIsTransmitted = shouldRayTransmit(n1, n2, reflectionCoeff, incAngle, currentP);
+						bool rayIsTransmitted = shouldRayTransmit(n1, n2, reflectionCoeff, incAngle, currentP._ray);
 
 					
 
 						//std::cout << "refraction, i = " << i << ' ' //<< &currentP.getIntersectedObject() << ' '
-						//	<< tempInter._t << pIntersects[0].first._intersectPoint << ' ' 
+						//	<< tempInter._t << pIntersect->first._intersectPoint << ' ' 
 						//	<< currentP.isInsideObject() << ' ' << rayIsTransmitted << ' '
 						//	<< currentP.getNormalizedDirection() << ' '
 						//	<< '\n';
@@ -185,27 +193,26 @@ void PhotonMap::photonMapBuilderThreadFn(const SceneGeometry& geometry, std::vec
 						///* DEBUG */ rayIsTransmitted = true;
 						if (rayIsTransmitted)
 						{
-							Photon refractedPhoton = computeRefractedRay(
-								tempInter._normal, currentP, tempInter._intersectPoint, currentP.isInsideObject());
-							//refractedPhoton.setColor(Color(1000000));
-							refractedPhoton.setColor(currentP.getColor() * (1.f - reflectionCoeff));
-							const auto& color = refractedPhoton.getColor();
+							Photon refractedPhoton{ computeRefractedRay(
+								tempInter._normal, currentP._ray, tempInter._intersectPoint, currentP._ray.isInsideObject()) };
+							//refractedPhoton._flux = Color(1000000);
+							refractedPhoton._flux = currentP._flux * (1.f - reflectionCoeff);
 
 							//if (color.x > 1.0 || color.y > 1.0 || color.z > 1.0)
 							//	std::cout << color.x << " " << color.y << " " << color.z << "\n";
 
 							//std::cout << currentP.getNormalizedDirection() << ' ' << refractedPhoton.getNormalizedDirection() << '\n';
 
-							photonQueue.push(std::move(refractedPhoton));
+							photonQueue.push(refractedPhoton);
 						}
 					
 						// TODO This cutoff is somewhat arbitrary, and slightly different from in the rendering step.
 						// This is bcs the information needed for that is not available here. It might be a good idea to fix this
-						if (!currentP.isInsideObject())
+						if (!currentP._ray.isInsideObject())
 						{
-							Photon reflectedPhoton = computeReflectedRay(tempInter._normal, currentP, tempInter._intersectPoint);
-							reflectedPhoton.setColor(reflectedPhoton.getColor() * reflectionCoeff);
-							photonQueue.push(std::move(reflectedPhoton));
+							Photon reflectedPhoton{ computeReflectedRay(tempInter._normal, currentP._ray, tempInter._intersectPoint) };
+							reflectedPhoton._flux = currentP._flux * reflectionCoeff;
+							photonQueue.push(reflectedPhoton);
 						}
 					}
 				}
@@ -215,14 +222,13 @@ void PhotonMap::photonMapBuilderThreadFn(const SceneGeometry& geometry, std::vec
 	}
 }
 
-void PhotonMap::addShadowPhotons(std::vector<IntersectionSurface>& inputData, std::vector<PhotonNode>& spMap)
+void PhotonMap::addShadowPhotons(const Ray& ray, float firstHit, const SceneGeometry& geometry, std::vector<PhotonNode>& spMap)
 {
 	//std::lock_guard<std::mutex> tempLock{ this->_mutex };
-	for (size_t i = 1; i < inputData.size(); i++)
-	{
-		auto tempInter = inputData[i].intersectionData;
-		spMap.push_back((PhotonNode{tempInter._intersectPoint}));
-	}
+	ArenaVector<float> distances{ ScratchArena::local() };
+	photonHitsBeyond(ray, firstHit, geometry, distances);
+	for (const float t : distances)
+		spMap.push_back((PhotonNode{ ray.getStart() + Vertex{ ray.getNormalizedDirection() * t, 0.0f } }));
 }
 
 void PhotonMap::addPhoton(PhotonNode&& currentPhoton, std::vector<PhotonNode>& photonData)
@@ -237,16 +243,18 @@ void PhotonMap::addPhoton(PhotonNode&& currentPhoton, std::vector<PhotonNode>& p
 	photonData.push_back(std::move(currentPhoton));
 }
 
-Ray PhotonMap::generateRandomPhotonFromLight(const float x, const float y)
+Photon PhotonMap::generateRandomPhotonFromLight(const float x, const float y, RandomStream& random)
 {
-	const Vertex randPointOnLight{ x + _rng(_gen), y + _rng(_gen), 4.999f, 1.f };
+	const float xOffset = random.next();
+	const float yOffset = random.next();
+	const Vertex randPointOnLight{ x + xOffset, y + yOffset, 4.999f, 1.f };
 	Direction randDir{ 0.f, 0.f, 1.f };
-	randDir = glm::rotateY(randDir, randInclination(_gen, _rng));
-	randDir = glm::rotateZ(randDir, randAzimuth(_gen, _rng));
+	randDir = glm::rotateY(randDir, randInclination(random));
+	randDir = glm::rotateZ(randDir, randAzimuth(random));
 
 	const Vertex randEndPoint = randPointOnLight - glm::vec4(randDir, 0.f);
 
-	return Ray{ randPointOnLight, randEndPoint };
+	return Photon{ Ray{ randPointOnLight, randEndPoint } };
 }
 
 constexpr float PhotonMap::calculateDeltaFlux() const
@@ -263,32 +271,32 @@ constexpr float PhotonMap::calculateDeltaFlux() const
 	return glm::pi<float>() * L0 / static_cast<float>(N_PHOTONS_TO_CAST);
 }
 
-void PhotonMap::handleMonteCarloPhoton(std::queue<Ray>& queue, IntersectionSurface& inter, Photon& currentPhoton)
+void PhotonMap::handleMonteCarloPhoton(PhotonQueue& queue, IntersectionSurface& inter, Photon& currentPhoton, RandomStream& random)
 {
-	float rand1 = _rng(_gen);
-	float rand2 = _rng(_gen);
+	float rand1 = random.next();
+	float rand2 = random.next();
 
 	if (rand1 + Config::monteCarloTerminationProbability() < 1.f)
 	{
-		Photon generatedPhoton = generateRandomReflectedRay(
-			currentPhoton.getNormalizedDirection(),
+		// rand1 decided the roulette, scaled back up it still covers the whole azimuth
+		Photon generatedPhoton{ generateRandomReflectedRay(
 			inter.intersectionData._normal,
 			inter.intersectionData._intersectPoint,
-			rand1,
-			rand2);
+			rand1 / (1.f - Config::monteCarloTerminationProbability()),
+			rand2) };
 
 		const double roughness = inter.intersectionObject->accessBRDF().computeBRDF(
-			generatedPhoton.getNormalizedDirection(),
-			-currentPhoton.getNormalizedDirection(),
+			generatedPhoton._ray.getNormalizedDirection(),
+			-currentPhoton._ray.getNormalizedDirection(),
 			inter.intersectionData._normal);
 
 		//TODO BRDF should be used here
 		//Radiance is spread over a hemisphere, normalizing nominator is up for debate
-		generatedPhoton.setColor(
-			currentPhoton.getColor() *
+		generatedPhoton._flux =
+			currentPhoton._flux *
 			roughness *
 			inter.intersectionObject->getColor() *
-			(glm::pi<double>() / (1.0 - Config::monteCarloTerminationProbability())));
-		queue.push(std::move(generatedPhoton));
+			(glm::pi<double>() / (1.0 - Config::monteCarloTerminationProbability()));
+		queue.push(generatedPhoton);
 	}
 }
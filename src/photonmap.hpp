@@ -1,11 +1,12 @@
 #pragma once
 
 #include <iostream>
-#include <random>
 #include <queue>
+#include <deque>
 #include <chrono>
 #include <kdtree.hpp>
 #include <mutex>
+#include <thread>
 #include <variant>
 #include <algorithm>
 #include <numeric>
@@ -14,8 +15,18 @@
 #include "brdf.hpp"
 #include "shapes.hpp"
 #include "raycastingfunctions.hpp"
+#include "random.hpp"
+#include "arena.hpp"
 
-using Photon = Ray; //For clarity
+// A photon is a ray that carries flux
+struct Photon
+{
+	Ray _ray;
+	Radiance _flux{ 1.0 };
+};
+
+// The photons of one path that are still to be traced
+using PhotonQueue = std::queue<Photon, std::deque<Photon, ArenaAllocator<Photon>>>;
 
 struct PhotonNode
 {
@@ -44,18 +55,20 @@ private:
 	std::mutex _mutex;
 	double _deltaFlux;
 
-	std::mt19937 _gen;
-	std::uniform_real_distribution<float> _rng;
+	// Photon i of the map uses the random stream of pixel i, photon paths are
+	// not coherent enough between photons to gain anything from stratification
+	IndependentSampler _sampler;
 
 	void photonMapBuilderThreadFn(const SceneGeometry& geometry, std::vector<PhotonNode>& pMap,
-		std::vector<PhotonNode>& spMap, size_t photonsToCast);
+		std::vector<PhotonNode>& spMap, size_t firstPhoton, size_t photonsToCast);
 
-	void addShadowPhotons(std::vector<IntersectionSurface>& inputData, std::vector<PhotonNode>& spMap);
+	// Shadow photons everywhere ray passes through a surface after the first one it hits
+	void addShadowPhotons(const Ray& ray, float firstHit, const SceneGeometry& geometry, std::vector<PhotonNode>& spMap);
 	void addPhoton(PhotonNode&& currentPhoton, std::vector<PhotonNode>& photonData);
 	void getPhotons(std::vector<PhotonNode>& foundPhotons, const PhotonNode& searchPoint);
-	Ray generateRandomPhotonFromLight(const float x, const float y);
+	Photon generateRandomPhotonFromLight(const float x, const float y, RandomStream& random);
 	constexpr float calculateDeltaFlux() const;
-	void handleMonteCarloPhoton(std::queue<Ray>& queue, IntersectionSurface& inter, Photon& currentPhoton);
+	void handleMonteCarloPhoton(PhotonQueue& queue, IntersectionSurface& inter, Photon& currentPhoton, RandomStream& random);
 
 	static constexpr float SEARCH_RANGE = 0.01f;
 	static constexpr size_t N_PHOTONS_TO_CAST = 5'000'000;
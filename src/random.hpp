@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sampler.hpp"
+
+// PCG output permutation used as an integer hash, see "Hash Functions for
+// GPU Rendering" (Jarzynski & Olano 2020)
+inline uint32_t pcgHash(uint32_t v)
+{
+	uint32_t state = v * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// The random numbers of one sample (or one photon path). The values come from a
+// Sampler keyed by (pixel, sample, bounce, dimension), so there is no generator
+// state to share between threads and a fixed seed always reproduces the same image.
+// The bounce and dimension counters advance in the order the integrator asks for numbers.
+class RandomStream
+{
+public:
+	// Has to be assigned a real stream before it is used
+	RandomStream() = default;
+	RandomStream(const Sampler& sampler, uint32_t pixel, uint32_t sample)
+		: _sampler{ &sampler }, _pixel{ pixel }, _sample{ sample }
+	{}
+
+	// Uniform float in [0, 1) for the next dimension of the current bounce
+	float next() { return _sampler->get(_pixel, _sample, _bounce, _dimension++); }
+
+	// Moves on to the next bounce, the dimensions start over from 0
+	void nextBounce()
+	{
+		++_bounce;
+		_dimension = 0;
+	}
+
+	// A copy for the second branch of a split path that goes on with numbers of its own
+	RandomStream branch() const
+	{
+		RandomStream copy{ *this };
+		copy._bounce = pcgHash(_bounce + 0x9E3779B9u);
+		copy._dimension = 0;
+		return copy;
+	}
+
+private:
+	const Sampler* _sampler = nullptr;
+	uint32_t _pixel = 0;
+	uint32_t _sample = 0;
+	uint32_t _bounce = 0;
+	uint32_t _dimension = 0;
+};
@@ -3,33 +3,24 @@
 #include <glm/glm.hpp>
 
 Ray::Ray(Vertex start, Vertex end)
-	: _rayColor{ Color{ 1.0, 1.0, 1.0 } }
+	: _origin{ start },
+	  _direction{ glm::normalize(Direction{ end } - Direction{ start }) }
 {
-	_start = std::make_unique<Vertex>(start);
-	_end = std::make_unique<Vertex>(end);
+	_invDirection = 1.0f / _direction;
 }
 
-Ray::Ray(Vertex start, Vertex end, Color color)
-	: Ray{ start, end }
+Ray Ray::segment(Vertex start, Vertex end)
 {
-	_rayColor = color;
+	Ray ray{ start, end };
+	ray._tMax = glm::length(Direction{ end } - Direction{ start });
+	return ray;
 }
 
-Ray::Ray(Ray& ray)
+Ray Ray::fromDirection(Vertex start, Direction direction)
 {
-	// TODO Using std::move when making a copy seems weird, is it correct?
-	// It really can't be. I have no idea why this was ever done
-	_left = std::move(ray._left);
-	_right = std::move(ray._right);
-	_start = std::move(ray._start);
-	_end = std::move(ray._end);
-
-	_rayColor = ray._rayColor;
-	_isInsideObject = ray._isInsideObject;
-}
-
-Direction Ray::getNormalizedDirection() const
-{
-	// TODO Consider storing the direction as a member
-	return glm::normalize(Direction{ getEnd() } - Direction{ getStart() });
+	Ray ray;
+	ray._origin = start;
+	ray._direction = direction;
+	ray._invDirection = 1.0f / direction;
+	return ray;
 }
@@ -1,62 +1,39 @@
 #pragma once
 
-#include "triangle.hpp"
-#include "brdf.hpp"
-#include "shapes.hpp"
+#include <limits>
+#include <type_traits>
 
-class Ray
+#include "basic_types.hpp"
+
+// Only the geometry of a ray, small enough to be passed around by value.
+// Whatever a ray carries along a path (importance, flux, the tree links)
+// is stored next to it by the code that traces it
+struct Ray
 {
-public:
+	Ray() = default;
+	// The end point only gives the direction, the ray itself is unbounded
 	Ray(Vertex start, Vertex end);
-	Ray(Vertex start, Vertex end, Color color);
-	Ray(Ray& ray);
-	Ray(Ray&& ray) = default;
-	Ray& operator=(Ray&&) = default;
-
-	void setLeft(Ray&& ray) {
-		if (_intersectionData.has_value() == false)
-			std::cout << "ohh noo\n";
-		_left = std::make_unique<Ray>(ray);
-	}
-	Ray* getLeft() { return  _left ? _left.get() : nullptr; }
-	void setRight(Ray&& ray) { _right = std::make_unique<Ray>(ray); }
-	Ray* getRight() { return _right ? _right.get() : nullptr; }
-	void setParent(Ray* ray) { _parent = ray; }
-	Ray* getParent() { return _parent; }
-
-	Vertex getStart() const { return *_start; }
-	Vertex getEnd() const { return *_end; }
-	Direction getNormalizedDirection() const;
-
-	void setInsideObject(bool isInside) { _isInsideObject = isInside; }
-	bool isInsideObject() const { return _isInsideObject; }
-
-	// The color member is used to store importance when casting from camera
-	Color getColor() const { return _rayColor; }
-	void setColor(const Color color) { _rayColor = color; }
-
-	// Maybe this could be optimized...
-	void setIntersectionData(IntersectionData data) { _intersectionData = data; }
-	const std::optional<IntersectionData>& getIntersectionData() const { return _intersectionData; }
-	void setIntersectedObject(const SceneObject* obj) { _intersectedObject = obj; }
-	const std::optional<const SceneObject*>& getIntersectedObject() const { return _intersectedObject; }
-
-private:
-	std::unique_ptr<Vertex> _end;
-	std::unique_ptr<Vertex> _start;
-
-	bool _isInsideObject = false;
-
-	std::optional<IntersectionData> _intersectionData;
-	std::optional<const SceneObject*> _intersectedObject;
-
-	//Unique ptrs are used to avoid memory leaks
-	//Left: reflected, Right: refracted
-	std::unique_ptr<Ray> _left;
-	std::unique_ptr<Ray> _right;
-	Ray* _parent = nullptr;
-
-	// Used to carry importance and probably 
-	// later radiance for photon mapping (i think)
-	Radiance _rayColor;
+
+	// A ray that stops at end, used for shadow rays
+	static Ray segment(Vertex start, Vertex end);
+	// direction has to be normalized already
+	static Ray fromDirection(Vertex start, Direction direction);
+
+	Vertex getStart() const { return Vertex{ _origin, 1.0f }; }
+	Direction getNormalizedDirection() const { return _direction; }
+
+	void setInsideObject(bool isInside) { _insideObject = isInside; }
+	bool isInsideObject() const { return _insideObject; }
+
+	Direction _origin{ 0.0f };
+	// Every intersection test ignores hits closer than _tMin or further than _tMax
+	float _tMin = 0.0f;
+	Direction _direction{ 1.0f, 0.0f, 0.0f };
+	float _tMax = std::numeric_limits<float>::infinity();
+	Direction _invDirection{ 1.0f, std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+	// The medium flag, set while travelling through a transparent object
+	bool _insideObject = false;
 };
+
+static_assert(std::is_trivially_copyable<Ray>::value, "Rays are copied around by value");
+static_assert(sizeof(Ray) <= 64, "A ray should fit in a cache line");
@@ -3,6 +3,9 @@
 #include "ray.hpp"
 #include "scenegeometry.hpp"
 #include "config.hpp"
+#include "random.hpp"
+#include "diagnostics.hpp"
+#include "sampling.hpp"
 
 
 /************************
@@ -14,99 +17,61 @@ static constexpr float _airIndex = 1.f;
 static constexpr float _glassIndex = 1.5f;
 static constexpr float _reflectionOffset = 0.01;
 
-inline bool pathIsVisible(Ray& ray, const Direction& normal, const SceneGeometry& scene);
+inline bool pathIsVisible(const Ray& ray, const SceneGeometry& scene);
 
 /************************
 	Implementations
 ************************/
 template<typename T>
-T* calcIntersection(
-	std::vector<T>& objects,
-	Ray& ray,
+void calcIntersection(
+	const std::vector<T>& objects,
+	const Ray& ray,
 	float& minT,
-	std::optional<IntersectionData>& closestIntersectData,
-	SceneObject* closestIntersectObject)
+	std::optional<IntersectionSurface>& closest)
 {
-	T* intersectObject = static_cast<T*>(closestIntersectObject);
-
 	for (size_t i{ 0 }; i < objects.size(); ++i)
 	{
 		auto tempIntersection = objects[i].rayIntersection(ray);
 		//Did intersection occur, and is it closer than minT?
 		if (tempIntersection.has_value() && tempIntersection.value()._t < minT)
 		{
-			closestIntersectData = tempIntersection;
-			intersectObject = &objects[i];
+			closest = IntersectionSurface{ tempIntersection.value(), &objects[i] };
 			minT = tempIntersection.value()._t;
 		}
 	}
-	return intersectObject;
 }
 
-inline static bool rayIntersection(Ray& ray, SceneGeometry& geometry)
+// The closest intersection along ray, if there is one before its end
+inline std::optional<IntersectionSurface> rayIntersection(const Ray& ray, const SceneGeometry& geometry)
 {
-	std::optional<IntersectionData> closestIntersectData{};
-	SceneObject* closestIntersectObject = nullptr;
-	float minT = 1e+10;
-
-	closestIntersectObject = calcIntersection(geometry._sceneTris, ray, minT, closestIntersectData, closestIntersectObject);
-	closestIntersectObject = calcIntersection(geometry._tetrahedrons, ray, minT, closestIntersectData, closestIntersectObject);
-	closestIntersectObject = calcIntersection(geometry._spheres, ray, minT, closestIntersectData, closestIntersectObject);
-	closestIntersectObject = calcIntersection(geometry._ceilingLights, ray, minT, closestIntersectData, closestIntersectObject);
-
-	if (closestIntersectData.has_value())
-	{
-		ray.setIntersectedObject(closestIntersectObject);
-		ray.setIntersectionData(closestIntersectData.value());
-		return true;
-	}
-	return false;
+	return geometry._bvh.closestHit(ray, geometry);
 }
 
-
-template<typename T>
-inline void calcIntersection(
-	const std::vector<T>& objects,
-	Ray& ray,
-	std::vector<IntersectionSurface>& intersections)
+// The same by testing every object, the BVH has to agree with it
+inline std::optional<IntersectionSurface> rayIntersectionLinear(const Ray& ray, const SceneGeometry& geometry)
 {
-	for (size_t i{ 0 }; i < objects.size(); ++i)
-	{
-		objects[i].rayIntersections(ray, intersections);
-	}
+	std::optional<IntersectionSurface> closest{};
+	float minT = ray._tMax;
+
+	calcIntersection(geometry._sceneTris, ray, minT, closest);
+	calcIntersection(geometry._tetrahedrons, ray, minT, closest);
+	calcIntersection(geometry._spheres, ray, minT, closest);
+	calcIntersection(geometry._ceilingLights, ray, minT, closest);
+
+	return closest;
 }
 
-//Specialize for TriangleObj as these can only intersect once
-template<>
-inline void calcIntersection<TriangleObj>(
-	const std::vector<TriangleObj>& objects,
-	Ray& ray,
-	std::vector<IntersectionSurface>& intersections)
+
+// The closest surface a photon hits, photons pass through the lights they are emitted from
+inline std::optional<IntersectionSurface> photonIntersection(const Ray& ray, const SceneGeometry& geometry)
 {
-	for (size_t i{ 0 }; i < objects.size(); ++i)
-	{
-		auto tempIntersection = objects[i].rayIntersection(ray);
-		//Did intersection occur?
-		if (tempIntersection.has_value())
-		{
-			intersections.push_back(IntersectionSurface{
-				tempIntersection.value(),
-				&objects[i]});
-		}
-	}
+	return geometry._bvh.closestHit(ray, geometry, PrimitiveRef::SCATTERS_PHOTONS);
 }
 
-//Fills intersections with data and sorts increasingly by distance from photon origin (AKA closest first)
-inline void photonIntersection(Ray& ray, const SceneGeometry& geometry, std::vector<IntersectionSurface>& intersections)
+// The distances to every surface a photon would pass through after the one at firstHit, nearest first
+inline void photonHitsBeyond(const Ray& ray, float firstHit, const SceneGeometry& geometry, ArenaVector<float>& distances)
 {
-	calcIntersection(geometry._sceneTris, ray, intersections);
-	calcIntersection(geometry._tetrahedrons, ray, intersections);
-	calcIntersection(geometry._spheres, ray, intersections);
-
-	std::sort(intersections.begin(), intersections.end(), [](IntersectionSurface& a, IntersectionSurface& b)
-		{
-			return a.intersectionData._t < b.intersectionData._t;
-		});
+	geometry._bvh.hitsInOrder(ray, firstHit, geometry, PrimitiveRef::SCATTERS_PHOTONS, distances);
 }
 
 
@@ -142,7 +107,7 @@ inline Ray computeRefractedRay(const Direction& normal, const Ray& incomingRay,
 }
 
 //Calculates n1, n2, reflectionCoeff and returns if ray is transmitted or not
-inline bool shouldRayTransmit(double& n1, double& n2, double& reflectionCoeff, float incAngle, Ray& currentRay)
+inline bool shouldRayTransmit(double& n1, double& n2, double& reflectionCoeff, float incAngle, const Ray& currentRay)
 {
 	if (currentRay.isInsideObject())
 		n1 = _glassIndex, n2 = _airIndex;
@@ -163,62 +128,23 @@ inline bool shouldRayTransmit(double& n1, double& n2, double& reflectionCoeff, f
 	}
 }
 
-inline float randAzimuth(std::mt19937& _gen, std::uniform_real_distribution<float>& _rng)
+inline float randAzimuth(RandomStream& random)
 {
-	return TWO_PI * _rng(_gen);
+	return TWO_PI * random.next();
 }
-inline float randInclination(std::mt19937& _gen, std::uniform_real_distribution<float>& _rng)
+inline float randInclination(RandomStream& random)
 {
-	return glm::asin(glm::sqrt(_rng(_gen)));
+	return glm::asin(glm::sqrt(random.next()));
 }
 
+// A cosine weighted random direction on the hemisphere around normal
 inline Ray generateRandomReflectedRay(
-	const Direction& initialDirection, 
 	const Direction& normal,
 	const Vertex& intersectPoint,
 	float rand1, float rand2)
 {
-
-	//Determine local coordinate system and transformations matrices for it
-	const glm::vec3 Z{ normal };
-	const glm::vec3 X = glm::normalize(initialDirection - glm::dot(initialDirection, Z) * Z);
-	const glm::vec3 Y = glm::cross(-X, Z);
-	/* GLM: Column major order
-	 0  4  8  12
-	 1  5  9  13
-	 2  6 10  14
-	 3  7 11  15
-	*/
-	const glm::mat4 toLocalCoord =
-		glm::mat4{
-		X.x, Y.x, Z.x, 0.f,
-		X.y, Y.y, Z.y, 0.f,
-		X.z, Y.z, Z.z, 0.f,
-		0.f, 0.f, 0.f, 1.f } *
-		glm::mat4{
-		1.f, 0.f, 0.f, 0.f,
-		0.f, 1.f, 0.f, 0.f,
-		0.f, 0.f, 1.f, 0.f,
-		-intersectPoint.x, -intersectPoint.y, -intersectPoint.z, 1.f
-	};
-	const glm::mat4 toGlobalCoord = glm::inverse(toLocalCoord);
-
-	// Generate random azimuth (phi) and inclination (theta)
-	// Phi is caled to compensate for decreased range of rand1 since the ray is terminated 
-	// russian roulette for high values for rand1
-	const float phi = (glm::two_pi<float>() / (1 - Config::monteCarloTerminationProbability())) * rand1;
-	const float theta = glm::asin(glm::sqrt(rand2));
-	const float x = glm::cos(phi) * glm::sin(theta);
-	const float y = glm::sin(phi) * glm::sin(theta);
-	const float z = glm::cos(theta);
-
-	const glm::vec4 globalReflected = toGlobalCoord * glm::vec4{ glm::normalize(glm::vec3(x, y, z)), 1.f };
-
-	//Debug helper
-	//const glm::vec3 globalDirection{ glm::normalize(glm::vec3{globalReflected.x, globalReflected.y, globalReflected.z })};
-
-	glm::vec4 offset = glm::vec4(normal * _reflectionOffset, 0);
-	return Ray{ intersectPoint + offset, globalReflected };
+	const glm::vec4 offset = glm::vec4(normal * _reflectionOffset, 0);
+	return Ray::fromDirection(intersectPoint + offset, cosineSampleHemisphere(normal, rand1, rand2));
 }
 
 inline Direction computeShadowRayDirection(const Vertex& point, const Vertex& lightPoint)
@@ -226,16 +152,6 @@ inline Direction computeShadowRayDirection(const Vertex& point, const Vertex& li
 	return glm::normalize(glm::vec3(lightPoint) - glm::vec3(point));
 }
 
-inline bool objectIsVisible(const Ray& ray, const SceneObject& obj, const std::optional<IntersectionData>& input, const Direction& normal)
-{
-	return !(
-		input.has_value() // Intersection must exist
-		// Check if intersection is on the right side of the light (maybe this could be improved performance-wise?)
-		&& glm::length(glm::vec3(ray.getEnd() - ray.getStart())) > glm::length(input->_t * ray.getNormalizedDirection())
-		&& obj.getBRDF().getSurfaceType() != BRDF::TRANSPARENT
-		);
-}
-
 inline double shadowRayContribution(const Vertex& point, const Vertex& lightPoint, const Direction& normal, SceneGeometry& scene)
 {
 	Direction shadowRayVec = glm::normalize(glm::vec3(lightPoint) - glm::vec3(point));
@@ -245,83 +161,78 @@ inline double shadowRayContribution(const Vertex& point, const Vertex& lightPoin
 		return 0.0;
 	else
 	{
-		Ray shadowRay{ point, lightPoint };
-		return normalDotContribution * pathIsVisible(shadowRay, normal, scene);
+		Ray shadowRay = Ray::segment(point, lightPoint);
+		return normalDotContribution * pathIsVisible(shadowRay, scene);
 	}
 }
 
-inline bool pathIsVisible(Ray& ray, const Direction& normal, const SceneGeometry& scene)
+// Whether something that casts shadows lies within maxDistance of origin along the
+// normalized direction. Transparent objects and lights let the light through
+inline bool isOccluded(const Vertex& origin, const Direction& direction, float maxDistance, const SceneGeometry& geometry)
 {
-	bool visible = true;
-
-	auto itTetra = scene._tetrahedrons.begin();
-	auto itSphere = scene._spheres.begin();
-
-	//This loop is ugly but efficient
-	while ((itTetra != scene._tetrahedrons.end() || itSphere != scene._spheres.end()) && visible)
-	{
-		if (itTetra != scene._tetrahedrons.end() && visible)
-		{
-			visible = objectIsVisible(ray, *itTetra, itTetra->rayIntersection(ray), normal);
-			++itTetra;
-		}
-		if (itSphere != scene._spheres.end() && visible)
-		{
-			visible = objectIsVisible(ray, *itSphere, itSphere->rayIntersection(ray), normal);
-			++itSphere;
-		}
-	}
-
-	return visible;
+	Ray ray = Ray::fromDirection(origin, direction);
+	ray._tMax = maxDistance;
+	return geometry._bvh.occluded(ray, geometry);
 }
 
-inline Color localAreaLightContribution(const Ray& inc, const Vertex& point,
-	const Direction& normal, const SceneObject* obj, const SceneGeometry& scene)
+// Whether the shadow ray reaches its end
+inline bool pathIsVisible(const Ray& ray, const SceneGeometry& scene)
 {
-	static auto _gen = std::mt19937{ std::random_device{}() };
-	static auto _rng = std::uniform_real_distribution<float>{ 0.f, 1.f };
-
-	// TODO Adapt for varying amout of lights
-	auto light = scene._ceilingLights[0];
+	return !isOccluded(ray.getStart(), ray.getNormalizedDirection(), ray._tMax, scene);
+}
 
-	double acc = 0;
+// Picks the point (rand1, rand2) on the light and fills in the shadow ray towards it,
+// returns what the light contributes through that ray if nothing is in the way, as
+// one of numShadowRays samples
+inline Color sampleAreaLight(const Ray& inc, const Vertex& point, const Direction& normal,
+	const SceneObject* obj, const CeilingLight& light, float rand1, float rand2, int numShadowRays, Ray& shadowRay)
+{
+	// Define local coord.system at light surface
+	glm::vec3 v1 = light.leftFar - light.leftClose;
+	glm::vec3 v2 = light.rightClose - light.leftClose;
+	// Transform to global
+	glm::vec3 randPointAtLight = glm::vec3(light.leftClose) + rand1 * v1 + rand2 * v2;
 
-	for (size_t i = 0; i < static_cast<size_t>(Config::numShadowRaysPerIntersection()); i++)
-	{
-		float rand1 = _rng(_gen);
-		float rand2 = _rng(_gen);
-		// Define local coord.system at light surface
-		glm::vec3 v1 = light.leftFar - light.leftClose;
-		glm::vec3 v2 = light.rightClose - light.leftClose;
-		// Transform to global
-		glm::vec3 randPointAtLight = glm::vec3(light.leftClose) + rand1 * v1 + rand2 * v2;
-
-		glm::vec4 offset = glm::vec4(normal * _reflectionOffset, 0);
-		Ray shadowRay{ point + offset, Vertex{ randPointAtLight, 1.0f } };
-
-		if (pathIsVisible(shadowRay, normal, scene))
-		{
-			double lightDistance = glm::length(randPointAtLight - glm::vec3(point));
-			double cosAlpha = glm::dot(-shadowRay.getNormalizedDirection(), light.getNormal());
-			double cosBeta = glm::dot(shadowRay.getNormalizedDirection(), normal);
+	glm::vec4 offset = glm::vec4(normal * _reflectionOffset, 0);
+	shadowRay = Ray::segment(point + offset, Vertex{ randPointAtLight, 1.0f });
 
-			double brdf = obj->accessBRDF().computeBRDF(
-				shadowRay.getNormalizedDirection(),
-				-inc.getNormalizedDirection(),
-				normal);
+	double lightDistance = glm::length(randPointAtLight - glm::vec3(point));
+	double cosAlpha = glm::dot(-shadowRay.getNormalizedDirection(), light.getNormal());
+	double cosBeta = glm::dot(shadowRay.getNormalizedDirection(), normal);
 
-			if (lightDistance == 0)
-				std::cout << "panikorkester\n";
+	double brdf = obj->accessBRDF().computeBRDF(
+		shadowRay.getNormalizedDirection(),
+		-inc.getNormalizedDirection(),
+		normal);
 
-			acc += brdf * glm::clamp(cosAlpha * cosBeta, 0.0, 1.0) / (lightDistance * lightDistance);
-		}
-	}
+	if (lightDistance == 0)
+		Diagnostics::count(Diagnostic::ZERO_LIGHT_DISTANCE);
 
 	// TODO Hard coding area is ofc not great
 	constexpr double lightArea = 1;
 
 	constexpr double L0 = 1000.0 / (glm::pi<double>() * lightArea);
-	Color returnValue = acc * obj->getColor() * (lightArea * L0 * (1.0 / Config::numShadowRaysPerIntersection()));
+	return brdf * glm::clamp(cosAlpha * cosBeta, 0.0, 1.0) / (lightDistance * lightDistance)
+		* obj->getColor() * (lightArea * L0 * (1.0 / numShadowRays));
+}
+
+inline Color localAreaLightContribution(const Ray& inc, const Vertex& point,
+	const Direction& normal, const SceneObject* obj, const SceneGeometry& scene, int numShadowRays, RandomStream& random)
+{
+	// TODO Adapt for varying amout of lights
+	const auto& light = scene._ceilingLights[0];
+
+	Color returnValue{ 0.0 };
+	for (int i = 0; i < numShadowRays; i++)
+	{
+		float rand1 = random.next();
+		float rand2 = random.next();
+
+		Ray shadowRay;
+		Color contribution = sampleAreaLight(inc, point, normal, obj, light, rand1, rand2, numShadowRays, shadowRay);
+		if (pathIsVisible(shadowRay, scene))
+			returnValue += contribution;
+	}
 
 	return returnValue;
 }
@@ -0,0 +1,283 @@
+#include "sampler.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "random.hpp"
+
+namespace
+{
+	// Largest float below 1
+	constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+	float toUnitFloat(uint32_t bits)
+	{
+		// The top 24 bits fit exactly in a float mantissa, so the result never rounds up to 1
+		return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	uint32_t seedKey(uint64_t seed)
+	{
+		return pcgHash(static_cast<uint32_t>(seed >> 32) + pcgHash(static_cast<uint32_t>(seed)));
+	}
+
+	uint32_t reverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+		x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+		return x;
+	}
+
+	// Hash based Owen scrambling, Burley 2020
+	uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+	{
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+	{
+		return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+	}
+
+	// The first two Sobol dimensions as 32 bit fixed point fractions
+	uint32_t sobolDimension(uint32_t index, uint32_t dimension)
+	{
+		if (dimension == 0)
+			return reverseBits(index);
+
+		uint32_t result = 0;
+		for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+			if (index & 1u)
+				result ^= v;
+		return result;
+	}
+
+	uint32_t scrambledSobol(uint32_t sample, uint32_t dimension, uint32_t pairKey)
+	{
+		const uint32_t shuffledIndex = nestedUniformScramble(sample, pairKey);
+		const uint32_t point = sobolDimension(shuffledIndex, dimension & 1u);
+		return nestedUniformScramble(point, pcgHash(pairKey + 1u + (dimension & 1u)));
+	}
+
+	// Random permutation of [0, length) indexed by i, from "Correlated Multi-Jittered Sampling" (Kensler 2013)
+	uint32_t permute(uint32_t i, uint32_t length, uint32_t p)
+	{
+		uint32_t w = length - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do
+		{
+			i ^= p;
+			i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8;
+			i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1;
+			i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= (i & w) >> 11;
+			i *= 0x74dcb303;
+			i ^= (i & w) >> 2;
+			i *= 0x9e501cc3;
+			i ^= (i & w) >> 2;
+			i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= length);
+		return (i + p) % length;
+	}
+
+	std::vector<float> generateBlueNoiseMask()
+	{
+		constexpr int SIZE = static_cast<int>(BLUE_NOISE_SIZE);
+		constexpr int N = SIZE * SIZE;
+		constexpr float SIGMA = 1.5f;
+
+		// Toroidal gaussian, indexed by the wrapped offset between two pixels
+		std::vector<float> kernel(N);
+		for (int dy = 0; dy < SIZE; ++dy)
+		{
+			for (int dx = 0; dx < SIZE; ++dx)
+			{
+				const float x = static_cast<float>(std::min(dx, SIZE - dx));
+				const float y = static_cast<float>(std::min(dy, SIZE - dy));
+				kernel[dy * SIZE + dx] = std::exp(-(x * x + y * y) / (2.0f * SIGMA * SIGMA));
+			}
+		}
+
+		auto update = [&](std::vector<uint8_t>& pattern, std::vector<float>& energy, int p, bool add) {
+			pattern[p] = add ? 1 : 0;
+			const float sign = add ? 1.0f : -1.0f;
+			const int px = p % SIZE;
+			const int py = p / SIZE;
+			for (int y = 0; y < SIZE; ++y)
+				for (int x = 0; x < SIZE; ++x)
+					energy[y * SIZE + x] += sign * kernel[((y - py + SIZE) % SIZE) * SIZE + (x - px + SIZE) % SIZE];
+		};
+		// The set pixel with the highest energy
+		auto tightestCluster = [&](const std::vector<uint8_t>& pattern, const std::vector<float>& energy) {
+			int best = -1;
+			for (int i = 0; i < N; ++i)
+				if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+					best = i;
+			return best;
+		};
+		// The unset pixel with the lowest energy
+		auto largestVoid = [&](const std::vector<uint8_t>& pattern, const std::vector<float>& energy) {
+			int best = -1;
+			for (int i = 0; i < N; ++i)
+				if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+					best = i;
+			return best;
+		};
+
+		// Initial pattern of about 10% white noise, then relaxed until
+		// removing the tightest cluster creates the largest void
+		std::vector<uint8_t> initialPattern(N, 0);
+		std::vector<float> initialEnergy(N, 0.0f);
+		int numOnes = 0;
+		for (int i = 0; i < N; ++i)
+		{
+			if (toUnitFloat(pcgHash(static_cast<uint32_t>(i))) < 0.1f)
+			{
+				update(initialPattern, initialEnergy, i, true);
+				++numOnes;
+			}
+		}
+		for (int iteration = 0; iteration < N; ++iteration)
+		{
+			const int cluster = tightestCluster(initialPattern, initialEnergy);
+			update(initialPattern, initialEnergy, cluster, false);
+			const int largest = largestVoid(initialPattern, initialEnergy);
+			update(initialPattern, initialEnergy, largest, true);
+			if (largest == cluster)
+				break;
+		}
+
+		std::vector<int> rank(N, 0);
+
+		// Rank the initial points by removing the tightest clusters one by one
+		std::vector<uint8_t> pattern = initialPattern;
+		std::vector<float> energy = initialEnergy;
+		for (int r = numOnes - 1; r >= 0; --r)
+		{
+			const int cluster = tightestCluster(pattern, energy);
+			update(pattern, energy, cluster, false);
+			rank[cluster] = r;
+		}
+
+		// Then fill the largest voids until every pixel has a rank
+		pattern = initialPattern;
+		energy = initialEnergy;
+		for (int r = numOnes; r < N; ++r)
+		{
+			const int largest = largestVoid(pattern, energy);
+			update(pattern, energy, largest, true);
+			rank[largest] = r;
+		}
+
+		std::vector<float> mask(N);
+		for (int i = 0; i < N; ++i)
+			mask[i] = (rank[i] + 0.5f) / N;
+		return mask;
+	}
+}
+
+IndependentSampler::IndependentSampler(uint64_t seed)
+	: _seedKey{ seedKey(seed) }
+{
+}
+
+float IndependentSampler::get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const
+{
+	const uint32_t key = pcgHash(sample + pcgHash(pixel + _seedKey));
+	return toUnitFloat(pcgHash(dimension + pcgHash(bounce + key)));
+}
+
+StratifiedSampler::StratifiedSampler(uint64_t seed, int samplesPerPixel)
+	: _seedKey{ seedKey(seed) },
+	  _gridSize{ static_cast<uint32_t>(std::max(1.0, std::ceil(std::sqrt(static_cast<double>(samplesPerPixel))))) }
+{
+}
+
+float StratifiedSampler::get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const
+{
+	const uint32_t numCells = _gridSize * _gridSize;
+	const uint32_t round = sample / numCells;
+	const uint32_t pairKey = pcgHash(round + pcgHash(bounce + pcgHash((dimension >> 1) + pcgHash(pixel + _seedKey))));
+
+	const uint32_t cell = permute(sample % numCells, numCells, pairKey);
+	const uint32_t cellCoordinate = (dimension & 1u) ? cell / _gridSize : cell % _gridSize;
+	const float jitter = toUnitFloat(pcgHash(dimension + pcgHash(sample + pairKey)));
+
+	return std::min((cellCoordinate + jitter) / _gridSize, ONE_MINUS_EPSILON);
+}
+
+SobolSampler::SobolSampler(uint64_t seed)
+	: _seedKey{ seedKey(seed) }
+{
+}
+
+float SobolSampler::get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const
+{
+	const uint32_t pairKey = pcgHash(bounce + pcgHash((dimension >> 1) + pcgHash(pixel + _seedKey)));
+	return toUnitFloat(scrambledSobol(sample, dimension, pairKey));
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint64_t seed, int imageWidth)
+	: _seedKey{ seedKey(seed) }, _imageWidth{ static_cast<uint32_t>(std::max(imageWidth, 1)) },
+	  _mask{ blueNoiseMask() }
+{
+}
+
+float BlueNoiseSampler::get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const
+{
+	// The scrambling does not depend on the pixel, all pixels share one sequence
+	const uint32_t pairKey = pcgHash(bounce + pcgHash((dimension >> 1) + _seedKey));
+	const float value = toUnitFloat(scrambledSobol(sample, dimension, pairKey));
+
+	// Cranley-Patterson rotation by the mask, shifted differently for every dimension
+	const uint32_t shift = pcgHash(dimension + pairKey);
+	const uint32_t x = (pixel % _imageWidth + shift) % BLUE_NOISE_SIZE;
+	const uint32_t y = (pixel / _imageWidth + (shift >> 16)) % BLUE_NOISE_SIZE;
+
+	float rotated = value + _mask[y * BLUE_NOISE_SIZE + x];
+	if (rotated >= 1.0f)
+		rotated -= 1.0f;
+	return std::min(rotated, ONE_MINUS_EPSILON);
+}
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint64_t seed, int samplesPerPixel, int imageWidth)
+{
+	switch (type)
+	{
+	case SamplerType::STRATIFIED:
+		return std::make_unique<StratifiedSampler>(seed, samplesPerPixel);
+	case SamplerType::SOBOL:
+		return std::make_unique<SobolSampler>(seed);
+	case SamplerType::BLUE_NOISE:
+		return std::make_unique<BlueNoiseSampler>(seed, imageWidth);
+	case SamplerType::INDEPENDENT:
+	default:
+		return std::make_unique<IndependentSampler>(seed);
+	}
+}
+
+const std::vector<float>& blueNoiseMask()
+{
+	static const std::vector<float> mask = generateBlueNoiseMask();
+	return mask;
+}
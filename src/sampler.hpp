@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Source of the sample values for every sampling site in the renderer. A value is
+// addressed by the pixel, the sample index within that pixel, the bounce (the
+// event counter of the random stream) and the dimension within the bounce.
+// Consecutive dimension pairs (0, 1), (2, 3), ... are meant to be used as 2D points,
+// which is what the stratified and low discrepancy samplers distribute well.
+class Sampler
+{
+public:
+	virtual ~Sampler() = default;
+
+	// Uniform value in [0, 1)
+	virtual float get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const = 0;
+};
+
+// Every value is an independent hash, plain Monte Carlo
+class IndependentSampler : public Sampler
+{
+public:
+	explicit IndependentSampler(uint64_t seed);
+	float get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const override;
+private:
+	const uint32_t _seedKey;
+};
+
+// Jittered samples on a sqrt(n) x sqrt(n) grid per dimension pair, the cells are
+// visited in a random order per pixel and pair. Samples past n start a new grid.
+class StratifiedSampler : public Sampler
+{
+public:
+	StratifiedSampler(uint64_t seed, int samplesPerPixel);
+	float get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const override;
+private:
+	const uint32_t _seedKey;
+	uint32_t _gridSize;
+};
+
+// 2D Sobol points for every dimension pair, decorrelated between pairs by shuffling
+// the sample index and randomised with hash based Owen scrambling, see
+// "Practical Hash-based Owen Scrambling" (Burley 2020)
+class SobolSampler : public Sampler
+{
+public:
+	explicit SobolSampler(uint64_t seed);
+	float get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const override;
+private:
+	const uint32_t _seedKey;
+};
+
+// The same scrambled Sobol sequence in every pixel, offset per pixel by a blue
+// noise mask (toroidally shifted per dimension). The error between neighbouring
+// pixels then has a blue noise spectrum which looks a lot less noisy at low spp.
+class BlueNoiseSampler : public Sampler
+{
+public:
+	BlueNoiseSampler(uint64_t seed, int imageWidth);
+	float get(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) const override;
+private:
+	const uint32_t _seedKey;
+	const uint32_t _imageWidth;
+	const std::vector<float>& _mask;
+};
+
+enum class SamplerType
+{
+	INDEPENDENT,
+	STRATIFIED,
+	SOBOL,
+	BLUE_NOISE
+};
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint64_t seed, int samplesPerPixel, int imageWidth);
+
+// Side length of the blue noise mask
+constexpr uint32_t BLUE_NOISE_SIZE = 64;
+
+// A BLUE_NOISE_SIZE^2 void and cluster mask (Ulichney 1993) with values in (0, 1),
+// computed on first use
+const std::vector<float>& blueNoiseMask();
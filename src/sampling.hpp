@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// Completes the unit vector n to an orthonormal basis (tangent, bitangent, n) without
+// any branches or normalization, see "Building an Orthonormal Basis, Revisited"
+// (Duff et al. 2017)
+inline void orthonormalBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+{
+	const float sign = std::copysign(1.0f, n.z);
+	const float a = -1.0f / (sign + n.z);
+	const float b = n.x * n.y * a;
+	tangent = glm::vec3{ 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x };
+	bitangent = glm::vec3{ b, sign + n.y * n.y * a, -n.y };
+}
+
+// Maps the unit square to the unit disk keeping areas, and neighbouring points
+// neighbours, see "A Low Distortion Map Between Disk and Square" (Shirley & Chiu 1997)
+inline glm::vec2 concentricSampleDisk(float u1, float u2)
+{
+	const float x = 2.0f * u1 - 1.0f;
+	const float y = 2.0f * u2 - 1.0f;
+	if (x == 0.0f && y == 0.0f)
+		return glm::vec2{ 0.0f };
+
+	float r, phi;
+	if (std::abs(x) > std::abs(y))
+	{
+		r = x;
+		phi = glm::quarter_pi<float>() * (y / x);
+	}
+	else
+	{
+		r = y;
+		phi = glm::half_pi<float>() - glm::quarter_pi<float>() * (x / y);
+	}
+	return r * glm::vec2{ std::cos(phi), std::sin(phi) };
+}
+
+// A direction around +z with density cos(theta) / pi. Points spread evenly over the
+// disk and lifted up onto the hemisphere have exactly that density (Malley's method)
+inline glm::vec3 cosineSampleHemisphere(float u1, float u2)
+{
+	const glm::vec2 disk = concentricSampleDisk(u1, u2);
+	const float z = std::sqrt(std::max(0.0f, 1.0f - disk.x * disk.x - disk.y * disk.y));
+	return glm::vec3{ disk.x, disk.y, z };
+}
+
+// cosineSampleHemisphere around normal instead of +z
+inline glm::vec3 cosineSampleHemisphere(const glm::vec3& normal, float u1, float u2)
+{
+	glm::vec3 tangent, bitangent;
+	orthonormalBasis(normal, tangent, bitangent);
+	const glm::vec3 local = cosineSampleHemisphere(u1, u2);
+	return local.x * tangent + local.y * bitangent + local.z * normal;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <string>
+#include <sstream>
+
+#include "sampling.hpp"
+
+namespace
+{
+	constexpr size_t NUM_SAMPLES = 200'000;
+	constexpr int NUM_CHI_SQUARE_BINS = 20;
+	// The 99.9% quantile of chi-square with NUM_CHI_SQUARE_BINS - 1 degrees of freedom
+	constexpr double CHI_SQUARE_LIMIT = 43.82;
+	// Allowed distance of the mean from 2/3, in standard errors
+	constexpr double MEAN_TOLERANCE = 5.0;
+
+	int failures = 0;
+
+	void check(bool passed, const std::string& what)
+	{
+		std::cout << (passed ? "passed  " : "FAILED  ") << what << "\n";
+		if (!passed)
+			++failures;
+	}
+
+	std::string describe(const glm::vec3& n)
+	{
+		std::ostringstream stream;
+		stream << std::setprecision(8) << "(" << n.x << ", " << n.y << ", " << n.z << ")";
+		return stream.str();
+	}
+
+	// Unit length, perpendicular to each other and to n, and right handed
+	void checkBasis(const glm::vec3& n)
+	{
+		glm::vec3 tangent, bitangent;
+		orthonormalBasis(n, tangent, bitangent);
+
+		constexpr float tolerance = 1e-5f;
+		const bool unit = std::abs(glm::length(tangent) - 1.0f) < tolerance &&
+			std::abs(glm::length(bitangent) - 1.0f) < tolerance;
+		const bool orthogonal = std::abs(glm::dot(tangent, bitangent)) < tolerance &&
+			std::abs(glm::dot(tangent, n)) < tolerance && std::abs(glm::dot(bitangent, n)) < tolerance;
+		const bool rightHanded = glm::length(glm::cross(tangent, bitangent) - n) < tolerance;
+		check(unit && orthogonal && rightHanded, "orthonormal basis around " + describe(n));
+	}
+
+	// The directions around n have to stay above the surface, have a mean cosine of
+	// 2/3 and a uniformly distributed squared cosine, which is what density cos / pi means
+	void checkDistribution(const glm::vec3& n, std::mt19937& generator)
+	{
+		std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+		size_t below = 0;
+		double sum = 0.0;
+		std::vector<size_t> bins(NUM_CHI_SQUARE_BINS, 0);
+		for (size_t i = 0; i < NUM_SAMPLES; ++i)
+		{
+			const glm::vec3 direction = cosineSampleHemisphere(n, unit(generator), unit(generator));
+			const double cosTheta = glm::dot(direction, n);
+			if (cosTheta < -1e-6)
+				++below;
+
+			sum += cosTheta;
+			const double clamped = std::clamp(cosTheta, 0.0, 1.0);
+			++bins[std::min(static_cast<int>(clamped * clamped * NUM_CHI_SQUARE_BINS), NUM_CHI_SQUARE_BINS - 1)];
+		}
+
+		check(below == 0, "no samples below the surface around " + describe(n));
+
+		// cos has variance 1/2 - 4/9 = 1/18 under the cosine density
+		const double mean = sum / NUM_SAMPLES;
+		const double standardError = std::sqrt(1.0 / 18.0 / NUM_SAMPLES);
+		std::ostringstream meanText;
+		meanText << "E[cos] = " << std::setprecision(5) << mean << " around " << describe(n);
+		check(std::abs(mean - 2.0 / 3.0) < MEAN_TOLERANCE * standardError, meanText.str());
+
+		const double expected = static_cast<double>(NUM_SAMPLES) / NUM_CHI_SQUARE_BINS;
+		double chiSquare = 0.0;
+		for (size_t count : bins)
+			chiSquare += (count - expected) * (count - expected) / expected;
+		std::ostringstream chiText;
+		chiText << "cos^2 uniform, chi-square " << std::setprecision(4) << chiSquare << " around " << describe(n);
+		check(chiSquare < CHI_SQUARE_LIMIT, chiText.str());
+	}
+}
+
+// Statistical checks of the cosine weighted hemisphere sampling, returns the number of failed checks
+int main()
+{
+	std::mt19937 generator{ 2017 };
+
+	// Close to the poles is where the basis divides by almost nothing
+	std::vector<glm::vec3> normals{
+		glm::vec3{ 0.0f, 0.0f, 1.0f },
+		glm::vec3{ 0.0f, 0.0f, -1.0f },
+		glm::normalize(glm::vec3{ 1e-4f, -2e-4f, 1.0f }),
+		glm::normalize(glm::vec3{ -1e-4f, 1e-4f, -1.0f }),
+		glm::normalize(glm::vec3{ 1e-7f, 0.0f, -1.0f }),
+		glm::vec3{ 1.0f, 0.0f, 0.0f },
+		glm::vec3{ 0.0f, -1.0f, 0.0f }
+	};
+	std::normal_distribution<float> gaussian;
+	for (int i = 0; i < 8; ++i)
+		normals.push_back(glm::normalize(glm::vec3{ gaussian(generator), gaussian(generator), gaussian(generator) }));
+
+	for (const glm::vec3& n : normals)
+		checkBasis(n);
+	for (const glm::vec3& n : normals)
+		checkDistribution(n, generator);
+
+	std::cout << (failures == 0 ? "All checks passed\n" : "Some checks failed\n");
+	return failures;
+}
@@ -5,277 +5,295 @@
 #include "ray.hpp"
 #include "util.hpp"
 #include "raycastingfunctions.hpp"
+#include "diagnostics.hpp"
 
 Scene::Scene()
 	: _nCalculations{ 0 },
-	  _sceneGeometry{ }
+	  _sceneGeometry{ },
+	  _packetGeometry{ _sceneGeometry }
 {
-	_gen = std::mt19937{ std::random_device{}() };
-	_rng = std::uniform_real_distribution<float>{ 0.f, 1.f };
-
 	if (Config::usePhotonMapping())
 		_photonMap = std::make_unique<PhotonMap>(_sceneGeometry);
 
 	auto lightCenter = _sceneGeometry._ceilingLights[0].getCenterPoints();
 }
 
-Color Scene::raycastScene(Ray& initialRay)
+template<typename Settings>
+Color Scene::raycastScene(const Ray& initialRay, RandomStream& random, PathStatistics& statistics)
 {
-	RayTree tree{ initialRay, this };
-	tree.raytracePixel();
-	return tree.getPixelColor();
+	PathTracer<Settings> tracer{ this, random, statistics };
+	return tracer.trace(initialRay);
 }
 
-RayTree::RayTree(Ray& initialRay, Scene* scene)
-	: _gen{ std::random_device{}() }, _rng{ 0.f, 1.f },
-	  _scene{ scene }
+template<typename Settings>
+Color Scene::raycastScene(const Ray& initialRay, const std::optional<IntersectionSurface>& firstHit, RandomStream& random,
+	PathStatistics& statistics)
 {
-	_head = std::make_unique<Ray>(initialRay);
+	PathTracer<Settings> tracer{ this, random, statistics };
+	return tracer.trace(initialRay, firstHit);
 }
 
-void RayTree::raytracePixel()
+template<typename Settings>
+PathTracer<Settings>::PathTracer(Scene* scene, RandomStream& random, PathStatistics& statistics)
+	: _scene{ scene }, _random{ &random }, _statistics{ statistics }
 {
-	constructRayTree();
-	_finalColor = traverseRayTree(_head.get(), false);
 }
 
-void RayTree::constructRayTree()
+template<typename Settings>
+Color PathTracer<Settings>::trace(const Ray& initialRay)
 {
-	std::queue<Ray*> rays;
-	Ray* currentRay = _head.get();
-	rays.push(currentRay);
+	return trace(initialRay, rayIntersection(initialRay, _scene->_sceneGeometry));
+}
 
-	size_t rayTreeCounter{ 0 };
-	while (!rays.empty() && rayTreeCounter < _maxTreeSize)
-	{
-		currentRay = rays.front();
-		rays.pop();
+template<typename Settings>
+Color PathTracer<Settings>::trace(const Ray& initialRay, const std::optional<IntersectionSurface>& firstHit)
+{
+	Color radiance{ 0.0 };
+	_pending[_numPending++] = PathState{ initialRay, Color{ 1.0 }, PathDepth{}, false, false };
 
-		auto rayImportance = currentRay->getColor();
+	size_t raysTraced{ 0 };
+	while (_numPending > 0 && raysTraced < _maxPathRays)
+	{
+		const PathState state = _pending[--_numPending];
+		++raysTraced;
+		_random->nextBounce();
 
-		// The rayIntersection method adds intersection info to ray
-		bool intersected = rayIntersection(*currentRay, _scene->_sceneGeometry);
+		if (std::isnan(state._throughput.r) || std::isnan(state._throughput.g) || std::isnan(state._throughput.b))
+			Diagnostics::count(Diagnostic::NAN_THROUGHPUT);
 
-		if (!intersected)
+		// Only the initial ray is traced when nothing has been taken off the stack before
+		const auto hit = raysTraced == 1 ? firstHit : rayIntersection(state._ray, _scene->_sceneGeometry);
+		if (!hit)
 		{
-			std::cout << "A ray with no intersections detected\n";
+			Diagnostics::count(Diagnostic::ESCAPED_RAY);
+			++_statistics._endedNaturally;
 			continue;
 		}
 
-		const auto& currentIntersection = currentRay->getIntersectionData().value();
-		const auto& currentIntersectObject = currentRay->getIntersectedObject().value();
-		const auto& currentSurfaceType = currentIntersectObject->getBRDF().getSurfaceType();
-
-		if (currentSurfaceType == BRDF::LIGHT) // Terminate on light
-			; // The importance should *not* be set to white here
-		else if (currentSurfaceType == BRDF::REFLECTOR)
+		const auto surfaceType = hit->intersectionObject->getBRDF().getSurfaceType();
+		if (surfaceType == BRDF::LIGHT && !state._hasBeenDiffuselyReflected)
 		{
-			// All importance is reflected
-			attachReflected(currentIntersection, currentRay);
-			currentRay->getLeft()->setColor(currentRay->getColor());
-			rays.push(currentRay->getLeft());
-			++rayTreeCounter;
+			radiance += state._throughput * LIGHT_RADIANCE;
+			++_statistics._endedNaturally;
+			continue;
 		}
-		else if (currentSurfaceType == BRDF::DIFFUSE)
+
+		if (surfaceType != BRDF::TRANSPARENT)
 		{
-			// If photon mapping is used the reflection is handled by the photon map unless in shadow
-			if (!Config::usePhotonMapping() ||
-				(Config::usePhotonMapping() && _scene->_photonMap->areShadowPhotonsPresent(currentIntersection._intersectPoint)))
-			//if (!Config::usePhotonMapping())
-			{
-				float rand1 = _rng(_gen);
-				float rand2 = _rng(_gen);
-				if (rand1 + Config::monteCarloTerminationProbability() > 1.f); //Terminate ray
-				else
-				{
-					attachReflectedMonteCarlo(currentIntersection, currentRay, rand1, rand2);
-
-					const double roughness = currentIntersectObject->accessBRDF().computeBRDF(
-						currentRay->getLeft()->getNormalizedDirection(),
-						-currentRay->getNormalizedDirection(),
-						currentIntersection._normal);
-
-					currentRay->getLeft()->setColor(
-						(glm::pi<double>() / (1.0 - Config::monteCarloTerminationProbability()))
-						* currentRay->getColor()
-						* currentIntersectObject->getColor()
-						* roughness);
-
-					rays.push(currentRay->getLeft());
-					++rayTreeCounter;
-				}
-			}
+			radiance += state._throughput *
+				localLightContribution(state._ray, hit->intersectionData, hit->intersectionObject);
 		}
-		else if (currentSurfaceType == BRDF::TRANSPARENT)
+
+		// Terminate on light
+		if (surfaceType == BRDF::LIGHT)
 		{
-			float incAngle = glm::angle(-currentRay->getNormalizedDirection(), currentIntersection._normal);
-
-			// How much of the incoming importance/radiance is reflected, between 0 and 1.
-			// The rest of the importance/radiance is transmitted.
-			double reflectionCoeff, n1, n2;
-
-			if (currentRay->isInsideObject())
-				n1 = _glassIndex, n2 = _airIndex;
-			else
-				n1 = _airIndex, n2 = _glassIndex;
-
-			float brewsterAngle = asin(_airIndex / _glassIndex); // In radians // TODO Store this somewhere!
-
-			if (currentRay->isInsideObject() && incAngle > brewsterAngle) // Total internal reflection
-			{
-				reflectionCoeff = 1.f;
-
-				// Cut off ray if internally reflected more than one time
-				// Left: reflected, Right: refracted
-				bool isReflected = currentRay->getParent()->getLeft() == currentRay;
-				if (isReflected)
-				{
-					continue;
-				}
-			}
-			else // Transmission occurs, Schlicks equation for radiance distribution
-			{
-				double R0 = pow((n1 - n2) / (n1 + n2), 2);
-				reflectionCoeff = R0 + (1 - R0) * pow(1.0 - cos(incAngle), 5);
-
-				attachRefracted(currentIntersection, currentRay);
-
-				currentRay->getRight()->setColor((1.0 - reflectionCoeff) * currentRay->getColor());
-				rays.push(currentRay->getRight());
-				++rayTreeCounter;
-
-				// Cut off internal reflection if transmitted from inside object
-				if (currentRay->isInsideObject())
-					continue;
-			}
-
-			attachReflected(currentIntersection, currentRay);
-			currentRay->getLeft()->setColor(reflectionCoeff * currentRay->getColor());
-			rays.push(currentRay->getLeft());
-			++rayTreeCounter;
+			++_statistics._endedNaturally;
+			continue;
 		}
-	}
-}
-
-// THIS IS COMPLETELY RECURSIVE FOR NOW; i cant be bothered to figure out any other 
-// way atm
-Color RayTree::traverseRayTree(Ray* input, bool hasBeenDiffuselyReflected) const
-{
-	Ray* currentRay = input;
 
-	// DEBUG
-	if (someComponent(currentRay->getColor(), static_cast<bool(*)(double)>(std::isnan)))
-		std::cout << "isnan\n";
+		std::array<Continuation, 2> continuations;
+		const PathDepth depth = state._depth.after(surfaceType);
+		size_t numContinuations = scatter<Settings>(state._ray, state._isReflected, *hit, *_scene, *_random, continuations);
+		numContinuations = applyTermination(_scene->_terminationPolicy, depth, surfaceType, state._throughput,
+			*_random, continuations, numContinuations, _statistics);
 
-	Ray* left = currentRay->getLeft();
-	Ray* right = currentRay->getRight();
+		if (numContinuations == 1)
+			push(state, depth, continuations[0]);
+		else if (numContinuations == 2)
+			split(state, depth, continuations[0], continuations[1]);
+	}
 
-	// Ideally the ray should always intersect something
-	if (currentRay->getIntersectionData().has_value() == false)
-		return Color{ 0 };
+	// Whatever is still waiting ran out of ray budget
+	if (_numPending > 0)
+		Diagnostics::count(Diagnostic::PATH_RAY_CAP);
+	_statistics._endedByCap += _numPending;
+	_statistics._rays += raysTraced;
+	++_statistics._samples;
 
-	auto& intersectData = currentRay->getIntersectionData().value();
-	auto& intersectObject = currentRay->getIntersectedObject().value();
-	auto surfaceType = intersectObject->getBRDF().getSurfaceType();
+	return radiance;
+}
 
-	Color localLightContribution{ 0 };
+size_t applyTermination(const TerminationPolicy& policy, const PathDepth& depth, unsigned surfaceType,
+	const Color& throughput, RandomStream& random, std::array<Continuation, 2>& continuations,
+	size_t numContinuations, PathStatistics& statistics)
+{
+	if (numContinuations == 0)
+		++statistics._endedNaturally;
 
-	if (surfaceType != BRDF::TRANSPARENT)
+	size_t numSurviving = 0;
+	for (size_t i = 0; i < numContinuations; ++i)
 	{
-		if (Config::usePhotonMapping())
+		double survivalProbability;
+		const auto decision = policy.decide(
+			depth, surfaceType, throughput * continuations[i]._weight, random, survivalProbability);
+
+		if (decision == TerminationPolicy::ROULETTE)
+		{
+			++statistics._endedByRoulette;
+		}
+		else if (decision == TerminationPolicy::CAP)
 		{
-			bool shadowPhotonsPresent = _scene->_photonMap->areShadowPhotonsPresent(intersectData._intersectPoint);
-			if (!shadowPhotonsPresent)
-			//if (!left)
-			{
-				localLightContribution = _scene->_photonMap->getPhotonRadianceContrib(
-					-currentRay->getNormalizedDirection(), intersectObject, intersectData);
-			}
-			else
-			{
-				localLightContribution = localAreaLightContribution(
-					*currentRay,
-					intersectData._intersectPoint,
-					intersectData._normal,
-					intersectObject,
-					_scene->_sceneGeometry);
-			}
+			++statistics._endedByCap;
 		}
 		else
 		{
-			localLightContribution = localAreaLightContribution(
-				*currentRay,
-				intersectData._intersectPoint,
-				intersectData._normal,
-				intersectObject,
-				_scene->_sceneGeometry);
+			continuations[numSurviving] = continuations[i];
+			continuations[numSurviving]._weight /= survivalProbability;
+			++numSurviving;
 		}
 	}
+	return numSurviving;
+}
+
+template<typename Settings>
+size_t scatter(const Ray& ray, bool isReflected, const IntersectionSurface& hit, Scene& scene,
+	RandomStream& random, std::array<Continuation, 2>& continuations)
+{
+	const IntersectionData& intersection = hit.intersectionData;
+	const SceneObject* object = hit.intersectionObject;
+	const auto surfaceType = object->getBRDF().getSurfaceType();
 
-	if (left == nullptr && right == nullptr)
+	if (surfaceType == BRDF::REFLECTOR)
 	{
-		if (surfaceType == BRDF::LIGHT && !hasBeenDiffuselyReflected)
-			return Color{ 1000.0 / glm::pi<double>() };
-		else
-			return localLightContribution;
+		// All importance is reflected, in the same medium
+		Ray reflectedRay = computeReflectedRay(intersection._normal, ray, intersection._intersectPoint);
+		reflectedRay.setInsideObject(ray.isInsideObject());
+		continuations[0] = Continuation{ reflectedRay, Color{ 1.0 }, false, true };
+		return 1;
 	}
-	else if (left && right == nullptr)
+	else if (surfaceType == BRDF::DIFFUSE)
 	{
-		if (surfaceType == BRDF::DIFFUSE)
-			hasBeenDiffuselyReflected = true;
+		// If photon mapping is used the reflection is handled by the photon map unless in shadow
+		if (Settings::usePhotonMapping && !scene._photonMap->areShadowPhotonsPresent(intersection._intersectPoint))
+			return 0;
 
-		return safeDivide(left->getColor(), currentRay->getColor()) *
-			traverseRayTree(left, hasBeenDiffuselyReflected) + localLightContribution;
-	}
-	else if (left == nullptr && right)
-	{
-		return safeDivide(right->getColor(), currentRay->getColor()) *
-			traverseRayTree(right, hasBeenDiffuselyReflected) + localLightContribution;
+		// Whether the path goes on is up to the termination policy
+		float rand1 = random.next();
+		float rand2 = random.next();
+
+		Ray reflectedRay = generateRandomReflectedRay(
+			intersection._normal,
+			intersection._intersectPoint,
+			rand1, rand2);
+		reflectedRay.setInsideObject(ray.isInsideObject()); // TODO Is this ever true?
+
+		const double roughness = object->accessBRDF().computeBRDF(
+			reflectedRay.getNormalizedDirection(),
+			-ray.getNormalizedDirection(),
+			intersection._normal);
+
+		const Color weight = glm::pi<double>() * object->getColor() * roughness;
+
+		continuations[0] = Continuation{ reflectedRay, weight, true, true };
+		return 1;
 	}
-	else if (left && right) // Only happens for transparent objects
+	else if (surfaceType == BRDF::TRANSPARENT)
 	{
-		Color leftSubContrib = traverseRayTree(currentRay->getLeft(), hasBeenDiffuselyReflected) * left->getColor();
-		Color rightSubContrib = traverseRayTree(currentRay->getRight(), hasBeenDiffuselyReflected) * right->getColor();
+		float incAngle = glm::angle(-ray.getNormalizedDirection(), intersection._normal);
+
+		// How much of the incoming importance/radiance is reflected, between 0 and 1.
+		// The rest of the importance/radiance is transmitted.
+		double reflectionCoeff, n1, n2;
+
+		if (ray.isInsideObject())
+			n1 = _glassIndex, n2 = _airIndex;
+		else
+			n1 = _airIndex, n2 = _glassIndex;
+
+		float brewsterAngle = asin(_airIndex / _glassIndex); // In radians // TODO Store this somewhere!
+
+		Ray reflectedRay = computeReflectedRay(intersection._normal, ray, intersection._intersectPoint);
+		reflectedRay.setInsideObject(ray.isInsideObject());
+
+		if (ray.isInsideObject() && incAngle > brewsterAngle) // Total internal reflection
+		{
+			// Cut off ray if internally reflected more than one time
+			if (isReflected)
+				return 0;
+
+			continuations[0] = Continuation{ reflectedRay, Color{ 1.0 }, false, true };
+			return 1;
+		}
 
-		return safeDivide((leftSubContrib + rightSubContrib), currentRay->getColor()) + localLightContribution;
+		// Transmission occurs, Schlicks equation for radiance distribution
+		double R0 = pow((n1 - n2) / (n1 + n2), 2);
+		reflectionCoeff = R0 + (1 - R0) * pow(1.0 - cos(incAngle), 5);
+
+		Ray refractedRay = computeRefractedRay(
+			intersection._normal, ray, intersection._intersectPoint, ray.isInsideObject());
+		const Continuation refracted{ refractedRay, Color{ 1.0 - reflectionCoeff }, false, false };
+
+		// Cut off internal reflection if transmitted from inside object
+		if (ray.isInsideObject())
+		{
+			continuations[0] = refracted;
+			return 1;
+		}
+
+		continuations[0] = Continuation{ reflectedRay, Color{ reflectionCoeff }, false, true };
+		continuations[1] = refracted;
+		return 2;
 	}
+
+	return 0;
 }
 
-void RayTree::attachReflected(const IntersectionData& intData, Ray* currentRay) const
+template<typename Settings>
+Color PathTracer<Settings>::localLightContribution(const Ray& ray, const IntersectionData& intersection, const SceneObject* object)
 {
-	Ray reflectedRay = computeReflectedRay(
-		intData._normal,
-		*currentRay,
-		intData._intersectPoint);
-
-	// Reflected ray will always continue in the same medium
-	reflectedRay.setInsideObject(currentRay->isInsideObject());
+	if (Settings::usePhotonMapping && !_scene->_photonMap->areShadowPhotonsPresent(intersection._intersectPoint))
+	{
+		return _scene->_photonMap->getPhotonRadianceContrib(
+			-ray.getNormalizedDirection(), object, intersection);
+	}
 
-	currentRay->setLeft(std::move(reflectedRay));
-	currentRay->getLeft()->setParent(currentRay);
+	return localAreaLightContribution(
+		ray,
+		intersection._intersectPoint,
+		intersection._normal,
+		object,
+		_scene->_sceneGeometry,
+		Settings::numShadowRays(),
+		*_random);
 }
 
-void RayTree::attachReflectedMonteCarlo(const IntersectionData& intData, Ray* currentRay, float rand1, float rand2)
+template<typename Settings>
+void PathTracer<Settings>::push(const PathState& state, const PathDepth& depth, const Continuation& continuation)
 {
-	Ray reflectedRay = generateRandomReflectedRay(
-		currentRay->getNormalizedDirection(),
-		intData._normal,
-		intData._intersectPoint,
-		rand1, rand2);
-	reflectedRay.setInsideObject(currentRay->isInsideObject()); // TODO Is this ever true?
-
-	currentRay->setLeft(std::move(reflectedRay));
-	currentRay->getLeft()->setParent(currentRay);
+	_pending[_numPending++] = PathState{
+		continuation._ray,
+		state._throughput * continuation._weight,
+		depth,
+		state._hasBeenDiffuselyReflected || continuation._isDiffuse,
+		continuation._isReflected };
 }
 
-void RayTree::attachRefracted(const IntersectionData& intData, Ray* currentRay) const
+template<typename Settings>
+void PathTracer<Settings>::split(const PathState& state, const PathDepth& depth, const Continuation& reflected, const Continuation& refracted)
 {
-	Ray refractedRay = computeRefractedRay(
-		intData._normal,
-		*currentRay,
-		intData._intersectPoint,
-		currentRay->isInsideObject());
-
-	currentRay->setRight(std::move(refractedRay));
-	currentRay->getRight()->setParent(currentRay);
+	if (_numPending + 2 <= _maxPendingPaths)
+	{
+		push(state, depth, refracted);
+		push(state, depth, reflected);
+		return;
+	}
+
+	// Out of room, follow only one of them picked by Russian roulette and
+	// scale it up so the estimate stays the same in expectation
+	Diagnostics::count(Diagnostic::PENDING_STACK_FULL);
+	const double reflectProbability = reflected._weight.x / (reflected._weight.x + refracted._weight.x);
+	Continuation chosen = _random->next() < reflectProbability ? reflected : refracted;
+	chosen._weight /= chosen._isReflected ? reflectProbability : 1.0 - reflectProbability;
+	push(state, depth, chosen);
 }
+
+#define INSTANTIATE_SCENE_KERNEL(photonMapping, shadowRays) \
+	template class PathTracer<KernelSettings<photonMapping, shadowRays>>; \
+	template Color Scene::raycastScene<KernelSettings<photonMapping, shadowRays>>( \
+		const Ray&, RandomStream&, PathStatistics&); \
+	template Color Scene::raycastScene<KernelSettings<photonMapping, shadowRays>>( \
+		const Ray&, const std::optional<IntersectionSurface>&, RandomStream&, PathStatistics&); \
+	template size_t scatter<KernelSettings<photonMapping, shadowRays>>( \
+		const Ray&, bool, const IntersectionSurface&, Scene&, RandomStream&, std::array<Continuation, 2>&);
+FOR_EACH_KERNEL_SETTINGS(INSTANTIATE_SCENE_KERNEL)
+#undef INSTANTIATE_SCENE_KERNEL
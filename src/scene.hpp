@@ -6,8 +6,8 @@
 #include <thread>
 #include <iomanip>
 #include <queue>
-#include <random>
 #include <functional>
+#include <array>
 
 #include <glm/gtx/vector_angle.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -17,16 +17,31 @@
 #include "config.hpp"
 #include "photonmap.hpp"
 #include "scenegeometry.hpp"
+#include "random.hpp"
+#include "ray.hpp"
+#include "packet.hpp"
+#include "termination.hpp"
+#include "kernel.hpp"
 
 class Scene
 {
 public:
 	Scene();
-	Color raycastScene(Ray& initialRay);
+	// Settings is the KernelSettings instantiation matching the config. How the path ended is
+	// added to statistics, the caller records those with _terminationPolicy for a whole batch
+	template<typename Settings>
+	Color raycastScene(const Ray& initialRay, RandomStream& random, PathStatistics& statistics);
+	// The same for a ray whose first hit is already known, from a packet
+	template<typename Settings>
+	Color raycastScene(const Ray& initialRay, const std::optional<IntersectionSurface>& firstHit, RandomStream& random,
+		PathStatistics& statistics);
 	unsigned getNCalculations() const { return _nCalculations; }
 
 	SceneGeometry _sceneGeometry;
 	std::unique_ptr<PhotonMap> _photonMap;
+	// For tracing camera rays in packets, refers to _sceneGeometry
+	PacketGeometry _packetGeometry;
+	TerminationPolicy _terminationPolicy;
 
 private:
 	mutable long long unsigned _nCalculations;
@@ -35,36 +50,72 @@ private:
 	// intersection
 	static constexpr float _reflectionOffset = 0.0001;
 
-	mutable std::mt19937 _gen;
-	mutable std::uniform_real_distribution<float> _rng;
-	
 	static constexpr float _airIndex = 1.f;
 	static constexpr float _glassIndex = 1.5f;
 };
 
-class RayTree
+// A ray a path continues with after hitting a surface
+struct Continuation
+{
+	Ray _ray;
+	// What the path throughput is multiplied with
+	Color _weight;
+	// Lights seen after a diffuse bounce were already counted by the shadow rays
+	bool _isDiffuse;
+	// Internal reflections inside glass are only followed once
+	bool _isReflected;
+};
+
+// Decides how a path that hit a surface other than a light goes on and fills in
+// the continuations, 0 if the path ends, 1 or 2 (reflected and refracted, in
+// that order) for glass. isReflected tells if the incoming ray was reflected
+template<typename Settings>
+size_t scatter(const Ray& ray, bool isReflected, const IntersectionSurface& hit, Scene& scene,
+	RandomStream& random, std::array<Continuation, 2>& continuations);
+
+// Lets the termination policy decide on each continuation of a path with the given throughput
+// and depth, the depth includes the interaction that produced them. The survivors are moved to
+// the front and scaled up, how the others ended is counted in statistics. Returns how many survive
+size_t applyTermination(const TerminationPolicy& policy, const PathDepth& depth, unsigned surfaceType,
+	const Color& throughput, RandomStream& random, std::array<Continuation, 2>& continuations,
+	size_t numContinuations, PathStatistics& statistics);
+
+// The emitted radiance of the lights, seen directly or through specular surfaces
+constexpr double LIGHT_RADIANCE = 1000.0 / glm::pi<double>();
+
+// Follows a camera ray through the scene and adds up the radiance it brings back.
+// The path throughput is carried forward so every vertex is only visited once.
+// Glass splits a path in a reflected and a refracted one, the one not followed
+// right away waits on a small fixed size stack
+template<typename Settings>
+class PathTracer
 {
 public:
-	RayTree() = default;
-	RayTree(Ray& initialRay, Scene* scene);
-	void raytracePixel();
-	Color getPixelColor() const { return _finalColor; }
+	PathTracer(Scene* scene, RandomStream& random, PathStatistics& statistics);
+	Color trace(const Ray& initialRay);
+	Color trace(const Ray& initialRay, const std::optional<IntersectionSurface>& firstHit);
 
 private:
-	std::unique_ptr<Ray> _head;
-	Color _finalColor;
-	Scene* _scene;
+	struct PathState
+	{
+		Ray _ray;
+		Color _throughput;
+		PathDepth _depth;
+		bool _hasBeenDiffuselyReflected;
+		bool _isReflected;
+	};
 
-	constexpr static size_t _maxTreeSize = 512;
-
-	//Random generator stuff for monte carlo
-	std::mt19937 _gen;
-	std::uniform_real_distribution<float> _rng;
+	Scene* _scene;
+	// The random numbers of the sample this path belongs to
+	RandomStream* _random;
 
-	void constructRayTree();
-	Color traverseRayTree(Ray* input, bool hasBeenDiffuselyReflected) const;
+	constexpr static size_t _maxPathRays = 512;
+	constexpr static size_t _maxPendingPaths = 32;
+	std::array<PathState, _maxPendingPaths> _pending;
+	size_t _numPending = 0;
+	PathStatistics& _statistics;
 
-	void attachReflected(const IntersectionData& intData, Ray* currentRay) const;
-	void attachReflectedMonteCarlo(const IntersectionData& intData, Ray* currentRay, float rand1, float rand2);
-	void attachRefracted(const IntersectionData& intData, Ray* currentRay) const;
+	Color localLightContribution(const Ray& ray, const IntersectionData& intersection, const SceneObject* object);
+	void push(const PathState& state, const PathDepth& depth, const Continuation& continuation);
+	void split(const PathState& state, const PathDepth& depth, const Continuation& reflected, const Continuation& refracted);
 };
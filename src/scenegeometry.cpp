@@ -1,5 +1,10 @@
 #include "scenegeometry.hpp"
 
+#include <sstream>
+#include <iomanip>
+
+#include "config.hpp"
+
 SceneGeometry::SceneGeometry()
 {
 	std::cout << "Constructing scene...   ";
@@ -62,5 +67,14 @@ SceneGeometry::SceneGeometry()
 	//_spheres.emplace_back(BRDF{ BRDF::REFLECTOR }, 1.5f, Color{ 0.02, 0.02, 0.02 }, Vertex{ 9.f, 0.0f, -3.5f, 1.f });
 	_spheres.emplace_back(BRDF{ BRDF::TRANSPARENT }, 1.5f, Color{ 0.1, 0.1, 0.1 }, Vertex{ 6.f, 3.5f, -3.f, 1.f });
 	_spheres.emplace_back(BRDF{ BRDF::DIFFUSE, LAMBERTIAN }, 1.5f, Color{ 1.0, 1.0, 1.0 }, Vertex{ 6.f, -3.5f, -3.f, 1.f });
+
+	buildBvh(BvhBuildSettings{ Config::bvhSplitBins(), static_cast<size_t>(Config::bvhBuildThreads()) });
 	std::cout << "done!\n";
+
+	const BvhBuildStats& stats = _bvh.buildStats();
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(2) << "BVH with " << _bvh.numNodes() << " nodes over "
+		<< _bvh.numPrimitives() << " objects built in " << stats._seconds * 1e3 << " ms on "
+		<< stats._numThreads << " threads, SAH cost " << stats._sahCost << "\n";
+	std::cout << report.str();
 }
@@ -7,16 +7,23 @@
 
 #include "shapes.hpp"
 #include "brdf.hpp"
+#include "bvh.hpp"
 
 class SceneGeometry
 {
 public:
 	SceneGeometry();
 
+	// Has to be called after objects are added or removed
+	void buildBvh(const BvhBuildSettings& settings = {}) { _bvh.build(*this, settings); }
+
 	std::vector<TriangleObj> _sceneTris;
 	std::vector<Tetrahedron> _tetrahedrons;
 	std::vector<Sphere> _spheres;
 	std::vector<CeilingLight> _ceilingLights;
+
+	// Over all the objects above, for closest hit queries
+	Bvh _bvh;
 };
 
 //Wall, floor and ceiling geometry
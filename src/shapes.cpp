@@ -24,7 +24,7 @@ Tetrahedron::Tetrahedron(BRDF brdf, float radius, Color color, Vertex position)
 	_triangles.emplace_back(v[2], v[3], v[1], color);
 }
 
-std::optional<IntersectionData> Tetrahedron::rayIntersection(Ray& ray) const
+std::optional<IntersectionData> Tetrahedron::rayIntersection(const Ray& ray) const
 {
 	const Triangle* closestIntersectingTriangle = nullptr;
 	float minT = 1e+10;
@@ -56,22 +56,6 @@ std::optional<IntersectionData> Tetrahedron::rayIntersection(Ray& ray) const
 	return {};
 }
 
-void Tetrahedron::rayIntersections(Ray& ray, std::vector<IntersectionSurface>& toBeFilled) const
-{
-	for (auto& triangle : _triangles)
-	{
-		float t = triangle.rayIntersection(ray);
-		if (t != -1)
-		{
-			IntersectionData temp{
-				ray.getStart() + Vertex{ ray.getNormalizedDirection() * t, 0.0f },
-				triangle.getNormal(),
-				t };
-			toBeFilled.push_back(IntersectionSurface{ temp, this });
-		}
-	}
-}
-
 Sphere::Sphere(BRDF brdf, float radius, Color color, Vertex position)
 	: SceneObject{ brdf, color },
 	_radius { radius }, _position{ position }
@@ -79,11 +63,10 @@ Sphere::Sphere(BRDF brdf, float radius, Color color, Vertex position)
 
 }
 
-std::optional<IntersectionData> Sphere::rayIntersection(Ray& arg) const
+std::optional<IntersectionData> Sphere::rayIntersection(const Ray& arg) const
 {
-	glm::vec3 rayStart{ arg.getStart() };
-	glm::vec3 rayEnd{ arg.getEnd() };
-	glm::vec3 rayDirectionNormalized = glm::normalize(rayEnd - rayStart);
+	glm::vec3 rayStart{ arg._origin };
+	glm::vec3 rayDirectionNormalized = arg._direction;
 
 	glm::vec3 o_c = rayStart - glm::vec3{ _position.x, _position.y, _position.z };
 
@@ -102,10 +85,10 @@ std::optional<IntersectionData> Sphere::rayIntersection(Ray& arg) const
 		d = (-b) / 2;
 	else // Two intersections
 	{
-		// Pick the intersection that is closest to the starting point of the ray, while givning a positive d
+		// Pick the intersection that is closest to the starting point of the ray, while givning a d beyond tMin
 		d = ((-b) / 2) - glm::sqrt(expressionInSQRT);
 		float otherPossibleD = ((-b) / 2) + glm::sqrt(expressionInSQRT);
-		if (d < 0 && otherPossibleD > 0) // The intersecting ray is coming from inside the object
+		if (d < arg._tMin && otherPossibleD > arg._tMin) // The intersecting ray is coming from inside the object
 		{
 			d = otherPossibleD;
 			isInside = true;
@@ -122,7 +105,7 @@ std::optional<IntersectionData> Sphere::rayIntersection(Ray& arg) const
 	if (isInside)
 		intersectionPointNormal *= -1.0f;
 
-	if (d < 0) // Intersection located behind the object
+	if (d < arg._tMin) // Intersection located behind the object
 		return {};
 
 	return IntersectionData{
@@ -133,74 +116,47 @@ std::optional<IntersectionData> Sphere::rayIntersection(Ray& arg) const
 
 }
 
-void Sphere::rayIntersections(Ray& arg, std::vector<IntersectionSurface>& toBeFilled) const
+float Sphere::hitDistance(const Ray& arg) const
 {
-	glm::vec3 rayStart{ arg.getStart() };
-	glm::vec3 rayEnd{ arg.getEnd() };
-	glm::vec3 rayDirectionNormalized = glm::normalize(rayEnd - rayStart);
+	const glm::vec3 o_c = arg._origin - glm::vec3{ _position };
 
-	glm::vec3 o_c = rayStart - glm::vec3{ _position.x, _position.y, _position.z };
+	const double a = glm::dot(arg._direction, arg._direction);
+	const double b = glm::dot(o_c, arg._direction * 2.0f);
+	const double c = glm::dot(o_c, o_c) - _radius * _radius;
 
-	double a = glm::dot(rayDirectionNormalized, rayDirectionNormalized);
-	double b = glm::dot(o_c, rayDirectionNormalized * 2.0f);
-	double c = glm::dot(o_c, o_c) - _radius * _radius;
-	float d{};
+	const double expressionInSQRT = glm::pow(b / 2, 2) - a * c;
+	if (expressionInSQRT < 0)
+		return -1.0f;
 
-	double expressionInSQRT = glm::pow(b / 2, 2) - a * c;
+	// The far intersection if the ray starts inside, the same as rayIntersection
+	double d = ((-b) / 2) - glm::sqrt(expressionInSQRT);
+	const float otherPossibleD = ((-b) / 2) + glm::sqrt(expressionInSQRT);
+	if (d < arg._tMin && otherPossibleD > arg._tMin)
+		d = otherPossibleD;
 
-	if (expressionInSQRT < 0) //No intersections
-		return;
-	else if (expressionInSQRT > -0 && expressionInSQRT < 0) //One intersection
-	{
-		d = (-b) / 2.f;
-		glm::vec3 intersection = rayStart + rayDirectionNormalized * d;
-		glm::vec3 intersectionPointNormal = glm::normalize(glm::vec3{
-			intersection.x - _position.x,
-			intersection.y - _position.y,
-			intersection.z - _position.z });
-		IntersectionData temp{
-			Vertex(intersection, 1.f),
-			intersectionPointNormal,
-			d
-		};
-	}
-	else // Two intersections
-	{
-		d = ((-b) / 2) - glm::sqrt(expressionInSQRT);
-		glm::vec3 intersection1 = rayStart + rayDirectionNormalized * d;
-		glm::vec3 intersectionPointNormal1 = glm::normalize(glm::vec3{
-			intersection1.x - _position.x,
-			intersection1.y - _position.y,
-			intersection1.z - _position.z });
-		IntersectionData temp1{
-			Vertex(intersection1, 1.f),
-			intersectionPointNormal1,
-			d
-		};
-
-		float d2 = ((-b) / 2) + glm::sqrt(expressionInSQRT);
-		glm::vec3 intersection2 = rayStart + rayDirectionNormalized * d2;
-		glm::vec3 intersectionPointNormal2 = glm::normalize(glm::vec3{
-			intersection2.x - _position.x,
-			intersection2.y - _position.y,
-			intersection2.z - _position.z });
-		IntersectionData temp2{
-			Vertex(intersection2, 1.f),
-			intersectionPointNormal2,
-			d2
-		};
-
-		if (d < 0 && d2 > 0) // The intersecting ray is coming from inside the object
-		{
-			temp1._normal *= -1; // Flip normal
-			temp2._normal *= -1; // Flip normal
-		}
+	return d < arg._tMin ? -1.0f : static_cast<float>(d);
+}
 
-		if (d > 0)
-			toBeFilled.push_back(IntersectionSurface{ temp1, this });
-		if (d2 > 0)
-			toBeFilled.push_back(IntersectionSurface{ temp2, this });
-	}
+int Sphere::hitDistances(const Ray& arg, float distances[2]) const
+{
+	const glm::vec3 o_c = arg._origin - glm::vec3{ _position };
+
+	const double a = glm::dot(arg._direction, arg._direction);
+	const double b = glm::dot(o_c, arg._direction * 2.0f);
+	const double c = glm::dot(o_c, o_c) - _radius * _radius;
+
+	const double expressionInSQRT = glm::pow(b / 2, 2) - a * c;
+	if (expressionInSQRT < 0)
+		return 0;
+
+	const float nearD = ((-b) / 2) - glm::sqrt(expressionInSQRT);
+	const float farD = ((-b) / 2) + glm::sqrt(expressionInSQRT);
+	int count = 0;
+	if (nearD > arg._tMin)
+		distances[count++] = nearD;
+	if (farD > arg._tMin)
+		distances[count++] = farD;
+	return count;
 }
 
 TriangleObj::TriangleObj(BRDF brdf, Vertex v1, Vertex v2, Vertex v3, Color color)
@@ -211,7 +167,7 @@ TriangleObj::TriangleObj(BRDF brdf, Vertex v1, Vertex v2, Vertex v3, Direction n
 	: SceneObject{ brdf, color }, _basicTriangle{ v1, v2, v3, normal, color }
 { }
 
-std::optional<IntersectionData> TriangleObj::rayIntersection(Ray& arg) const
+std::optional<IntersectionData> TriangleObj::rayIntersection(const Ray& arg) const
 {
 	float t = _basicTriangle.rayIntersection(arg);
 	if (t == -1)
@@ -238,7 +194,7 @@ CeilingLight::CeilingLight(BRDF brdf, float xPos, float yPos)
 	_triangles.push_back(t2);
 }
 
-std::optional<IntersectionData> CeilingLight::rayIntersection(Ray& arg) const
+std::optional<IntersectionData> CeilingLight::rayIntersection(const Ray& arg) const
 {
 	//We know there are always 2 triangles in the ceiling light
 	auto intersection1 = _triangles[0].rayIntersection(arg);
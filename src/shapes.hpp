@@ -10,6 +10,7 @@
 #include "basic_types.hpp"
 #include "brdf.hpp"
 #include "triangle.hpp"
+#include "arena.hpp"
 
 
 class SceneObject
@@ -36,8 +37,8 @@ class Tetrahedron : public SceneObject
 {
 public:
 	Tetrahedron(BRDF brdf, float radius, Color color, Vertex position);
-	std::optional<IntersectionData> rayIntersection(Ray& arg) const;
-	void rayIntersections(Ray& ray, std::vector<IntersectionSurface>& toBeFilled) const;
+	std::optional<IntersectionData> rayIntersection(const Ray& arg) const;
+	const std::vector<Triangle>& getTriangles() const { return _triangles; }
 private:
 	std::vector<Triangle> _triangles;
 };
@@ -47,8 +48,14 @@ class Sphere : public SceneObject
 public:
 	Sphere(BRDF brdf, float radius, Color color, Vertex position);
 	
-	std::optional<IntersectionData> rayIntersection(Ray& arg) const;
-	void rayIntersections(Ray& arg, std::vector<IntersectionSurface>& toBeFilled) const;
+	std::optional<IntersectionData> rayIntersection(const Ray& arg) const;
+	// Only the distance rayIntersection finds, -1 if there is no intersection
+	float hitDistance(const Ray& arg) const;
+	// The distances to where the ray enters and leaves the sphere that are ahead
+	// of it, nearest first, returns how many there are
+	int hitDistances(const Ray& arg, float distances[2]) const;
+	Vertex getPosition() const { return _position; }
+	float getRadius() const { return _radius; }
 private:
 	const Vertex _position;
 	const float _radius;
@@ -62,8 +69,9 @@ public:
 	TriangleObj() = default;
 	TriangleObj(BRDF brdf, Vertex v1, Vertex v2, Vertex v3, Color color);
 	TriangleObj(BRDF brdf, Vertex v1, Vertex v2, Vertex v3, Direction normal, Color color);
-	std::optional<IntersectionData> rayIntersection(Ray& arg) const;
+	std::optional<IntersectionData> rayIntersection(const Ray& arg) const;
 	Direction getNormal() const { return _basicTriangle.getNormal(); }
+	const Triangle& getTriangle() const { return _basicTriangle; }
 private:
 	const Triangle _basicTriangle;
 };
@@ -72,7 +80,7 @@ class CeilingLight : public SceneObject
 {
 public:
 	CeilingLight(BRDF brdf, float xPos, float yPos);
-	std::optional<IntersectionData> rayIntersection(Ray& arg) const;
+	std::optional<IntersectionData> rayIntersection(const Ray& arg) const;
 	Direction getNormal() const { return _triangles[0].getNormal(); }
 
 	// Cache corner points for use with shadow rays
@@ -82,6 +90,7 @@ public:
 	const Vertex rightClose;
 
 	std::pair<float, float> getCenterPoints() const { return _centerPoints; }
+	const std::vector<TriangleObj>& getTriangles() const { return _triangles; }
 private:
 	std::vector<TriangleObj> _triangles;
 	std::pair<float, float> _centerPoints;
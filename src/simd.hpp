@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+
+// Just enough of a SIMD float type for the packet tracing. The width follows the
+// instruction set the build targets, 8 lanes with AVX (configure with USE_AVX2),
+// 4 lanes with SSE, which every x86-64 CPU has, and 4 plain floats otherwise.
+// A mask is a FloatV with all bits of a lane set where the comparison holds.
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+constexpr size_t SIMD_WIDTH = 8;
+
+struct FloatV
+{
+	__m256 v;
+
+	FloatV() = default;
+	FloatV(__m256 value) : v{ value } {}
+	explicit FloatV(float value) : v{ _mm256_set1_ps(value) } {}
+
+	static FloatV load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline FloatV operator+(FloatV a, FloatV b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a, FloatV b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatV operator*(FloatV a, FloatV b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatV operator/(FloatV a, FloatV b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatV operator<(FloatV a, FloatV b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline FloatV operator<=(FloatV a, FloatV b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline FloatV operator>(FloatV a, FloatV b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline FloatV operator>=(FloatV a, FloatV b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline FloatV operator&(FloatV a, FloatV b) { return _mm256_and_ps(a.v, b.v); }
+inline FloatV operator|(FloatV a, FloatV b) { return _mm256_or_ps(a.v, b.v); }
+inline FloatV sqrt(FloatV a) { return _mm256_sqrt_ps(a.v); }
+// mask ? a : b
+inline FloatV select(FloatV mask, FloatV a, FloatV b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+// Bit i is set if lane i of the mask is
+inline int maskBits(FloatV mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+constexpr size_t SIMD_WIDTH = 4;
+
+struct FloatV
+{
+	__m128 v;
+
+	FloatV() = default;
+	FloatV(__m128 value) : v{ value } {}
+	explicit FloatV(float value) : v{ _mm_set1_ps(value) } {}
+
+	static FloatV load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline FloatV operator+(FloatV a, FloatV b) { return _mm_add_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a, FloatV b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatV operator*(FloatV a, FloatV b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatV operator/(FloatV a, FloatV b) { return _mm_div_ps(a.v, b.v); }
+inline FloatV operator<(FloatV a, FloatV b) { return _mm_cmplt_ps(a.v, b.v); }
+inline FloatV operator<=(FloatV a, FloatV b) { return _mm_cmple_ps(a.v, b.v); }
+inline FloatV operator>(FloatV a, FloatV b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline FloatV operator>=(FloatV a, FloatV b) { return _mm_cmpge_ps(a.v, b.v); }
+inline FloatV operator&(FloatV a, FloatV b) { return _mm_and_ps(a.v, b.v); }
+inline FloatV operator|(FloatV a, FloatV b) { return _mm_or_ps(a.v, b.v); }
+inline FloatV sqrt(FloatV a) { return _mm_sqrt_ps(a.v); }
+// mask ? a : b, SSE2 has no blend instruction
+inline FloatV select(FloatV mask, FloatV a, FloatV b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+// Bit i is set if lane i of the mask is
+inline int maskBits(FloatV mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+#include <cstring>
+#include <cstdint>
+
+constexpr size_t SIMD_WIDTH = 4;
+
+struct FloatV
+{
+	float v[SIMD_WIDTH];
+
+	FloatV() = default;
+	explicit FloatV(float value) { for (float& lane : v) lane = value; }
+
+	static FloatV load(const float* p) { FloatV r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(float* p) const { std::memcpy(p, v, sizeof(v)); }
+};
+
+namespace simd_detail
+{
+	template<typename Op>
+	FloatV perLane(FloatV a, FloatV b, Op op)
+	{
+		FloatV r;
+		for (size_t i = 0; i < SIMD_WIDTH; ++i)
+			r.v[i] = op(a.v[i], b.v[i]);
+		return r;
+	}
+
+	inline float maskLane(bool set)
+	{
+		const uint32_t bits = set ? 0xFFFFFFFFu : 0u;
+		float lane;
+		std::memcpy(&lane, &bits, sizeof(lane));
+		return lane;
+	}
+
+	inline uint32_t laneBits(float lane)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &lane, sizeof(bits));
+		return bits;
+	}
+}
+
+inline FloatV operator+(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return x + y; }); }
+inline FloatV operator-(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return x - y; }); }
+inline FloatV operator*(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return x * y; }); }
+inline FloatV operator/(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return x / y; }); }
+inline FloatV operator<(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(x < y); }); }
+inline FloatV operator<=(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(x <= y); }); }
+inline FloatV operator>(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(x > y); }); }
+inline FloatV operator>=(FloatV a, FloatV b) { return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(x >= y); }); }
+inline FloatV operator&(FloatV a, FloatV b)
+{
+	return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(simd_detail::laneBits(x) && simd_detail::laneBits(y)); });
+}
+inline FloatV operator|(FloatV a, FloatV b)
+{
+	return simd_detail::perLane(a, b, [](float x, float y) { return simd_detail::maskLane(simd_detail::laneBits(x) || simd_detail::laneBits(y)); });
+}
+inline FloatV sqrt(FloatV a) { FloatV r; for (size_t i = 0; i < SIMD_WIDTH; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+// mask ? a : b
+inline FloatV select(FloatV mask, FloatV a, FloatV b)
+{
+	FloatV r;
+	for (size_t i = 0; i < SIMD_WIDTH; ++i)
+		r.v[i] = simd_detail::laneBits(mask.v[i]) ? a.v[i] : b.v[i];
+	return r;
+}
+// Bit i is set if lane i of the mask is
+inline int maskBits(FloatV mask)
+{
+	int bits = 0;
+	for (size_t i = 0; i < SIMD_WIDTH; ++i)
+		if (simd_detail::laneBits(mask.v[i]))
+			bits |= 1 << i;
+	return bits;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "termination.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "brdf.hpp"
+#include "config.hpp"
+
+PathDepth PathDepth::after(unsigned surfaceType) const
+{
+	PathDepth next{ *this };
+	if (surfaceType == BRDF::DIFFUSE)
+		++next._diffuse;
+	else if (surfaceType == BRDF::REFLECTOR)
+		++next._specular;
+	else if (surfaceType == BRDF::TRANSPARENT)
+		++next._transmission;
+	return next;
+}
+
+TerminationPolicy::TerminationPolicy()
+	: _mode{ Config::rouletteMode() },
+	  _minDepth{ static_cast<unsigned>(Config::rouletteMinDepth()) },
+	  _maxDiffuseDepth{ static_cast<unsigned>(Config::maxDiffuseDepth()) },
+	  _maxSpecularDepth{ static_cast<unsigned>(Config::maxSpecularDepth()) },
+	  _maxTransmissionDepth{ static_cast<unsigned>(Config::maxTransmissionDepth()) },
+	  _fixedTerminationProbability{ Config::monteCarloTerminationProbability() }
+{
+}
+
+TerminationPolicy::Decision TerminationPolicy::decide(const PathDepth& depth, unsigned surfaceType,
+	const Color& throughput, RandomStream& random, double& survivalProbability) const
+{
+	survivalProbability = 1.0;
+
+	if (depth._diffuse > _maxDiffuseDepth || depth._specular > _maxSpecularDepth ||
+		depth._transmission > _maxTransmissionDepth)
+		return CAP;
+
+	if (depth.total() <= _minDepth)
+		return CONTINUE;
+
+	if (_mode == RouletteMode::FIXED)
+	{
+		if (surfaceType != BRDF::DIFFUSE)
+			return CONTINUE;
+		survivalProbability = 1.0 - _fixedTerminationProbability;
+	}
+	else
+	{
+		const double maxComponent = std::max({ throughput.r, throughput.g, throughput.b });
+		survivalProbability = std::min(maxComponent, 1.0);
+	}
+
+	// No random number is used up on paths that survive for sure
+	if (survivalProbability >= 1.0)
+		return CONTINUE;
+	if (random.next() >= survivalProbability)
+		return ROULETTE;
+	return CONTINUE;
+}
+
+void TerminationPolicy::record(const PathStatistics& statistics)
+{
+	_samples += statistics._samples;
+	_rays += statistics._rays;
+	_endedNaturally += statistics._endedNaturally;
+	_endedByRoulette += statistics._endedByRoulette;
+	_endedByCap += statistics._endedByCap;
+}
+
+void TerminationPolicy::resetStatistics()
+{
+	_samples = 0;
+	_rays = 0;
+	_endedNaturally = 0;
+	_endedByRoulette = 0;
+	_endedByCap = 0;
+}
+
+void TerminationPolicy::printStatistics() const
+{
+	const uint64_t samples = _samples;
+	const uint64_t ended = _endedNaturally + _endedByRoulette + _endedByCap;
+	if (samples == 0 || ended == 0)
+		return;
+
+	std::cout << "Path termination (" << (_mode == RouletteMode::FIXED ? "fixed" : "throughput")
+		<< " roulette after " << _minDepth << " bounces, at most " << _maxDiffuseDepth << " diffuse, "
+		<< _maxSpecularDepth << " specular and " << _maxTransmissionDepth << " transmission):\n"
+		<< "  " << static_cast<double>(_rays) / samples << " rays per sample on average\n"
+		<< "  " << ended << " path ends, " << 100.0 * _endedNaturally / ended << "% natural, "
+		<< 100.0 * _endedByRoulette / ended << "% roulette, " << 100.0 * _endedByCap / ended << "% caps\n\n";
+}
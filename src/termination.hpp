@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "basic_types.hpp"
+#include "random.hpp"
+
+enum class RouletteMode
+{
+	// Every diffuse bounce ends the path with monteCarloTerminationProbability
+	FIXED,
+	// The path survives with a probability equal to the largest color component of its
+	// throughput, paths that can only add very little to the pixel are the ones that end
+	THROUGHPUT
+};
+
+// How many interactions of each kind a path went through
+struct PathDepth
+{
+	uint16_t _diffuse = 0;
+	uint16_t _specular = 0;
+	uint16_t _transmission = 0;
+
+	unsigned total() const { return _diffuse + _specular + _transmission; }
+	// The depth after one more interaction with a surface of type surfaceType (BRDF::DIFFUSE, ...)
+	PathDepth after(unsigned surfaceType) const;
+};
+
+// What happened to the camera paths of one batch, added to the policy once the batch is done
+struct PathStatistics
+{
+	uint64_t _samples = 0;
+	uint64_t _rays = 0;
+	// Ended on a light, got absorbed or handed over to the photon map
+	uint64_t _endedNaturally = 0;
+	uint64_t _endedByRoulette = 0;
+	// Too deep for its interaction type, or the path used up its ray budget
+	uint64_t _endedByCap = 0;
+};
+
+// Decides when a camera path stops. Russian roulette only starts after minDepth
+// interactions, and every interaction type has a hard maximum depth of its own.
+// The policy also keeps count of how the paths it saw ended
+class TerminationPolicy
+{
+public:
+	enum Decision
+	{
+		CONTINUE,
+		ROULETTE,
+		CAP
+	};
+
+	// Takes its settings from the config
+	TerminationPolicy();
+
+	// Decides whether a path with the given throughput that just interacted with a
+	// surface of type surfaceType goes on, depth already includes that interaction.
+	// A surviving path has to be scaled by 1 / survivalProbability
+	Decision decide(const PathDepth& depth, unsigned surfaceType, const Color& throughput,
+		RandomStream& random, double& survivalProbability) const;
+
+	void record(const PathStatistics& statistics);
+	void resetStatistics();
+	void printStatistics() const;
+
+private:
+	RouletteMode _mode;
+	unsigned _minDepth;
+	unsigned _maxDiffuseDepth;
+	unsigned _maxSpecularDepth;
+	unsigned _maxTransmissionDepth;
+	float _fixedTerminationProbability;
+
+	std::atomic<uint64_t> _samples{ 0 };
+	std::atomic<uint64_t> _rays{ 0 };
+	std::atomic<uint64_t> _endedNaturally{ 0 };
+	std::atomic<uint64_t> _endedByRoulette{ 0 };
+	std::atomic<uint64_t> _endedByCap{ 0 };
+};
@@ -0,0 +1,113 @@
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(size_t numThreads)
+	: _queues(numThreads == 0 ? 1 : numThreads)
+{
+	_workers.reserve(_queues.size());
+	for (size_t i = 0; i < _queues.size(); ++i)
+		_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stop = true;
+	}
+	_wakeCondition.notify_all();
+
+	for (auto& worker : _workers)
+		worker.join();
+}
+
+size_t ThreadPool::hardwareThreads()
+{
+	// Get number of usable threads if possible, otherwise just use 1 thread
+	size_t numCores = std::thread::hardware_concurrency();
+	return numCores == 0 ? 1 : numCores;
+}
+
+void ThreadPool::parallelFor(size_t numTasks, const std::function<void(size_t)>& task)
+{
+	if (numTasks == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock{ _mutex };
+	_task = &task;
+	_remaining = numTasks;
+
+	// Give each worker a contiguous block, neighbouring tasks tend to be similar in cost
+	// and the stealing takes care of the imbalance that is left
+	const size_t numQueues = _queues.size();
+	for (size_t q = 0; q < numQueues; ++q)
+	{
+		const size_t begin = (numTasks * q) / numQueues;
+		const size_t end = (numTasks * (q + 1)) / numQueues;
+
+		std::lock_guard<std::mutex> queueLock{ _queues[q]._mutex };
+		for (size_t i = begin; i < end; ++i)
+			_queues[q]._tasks.push_back(i);
+	}
+
+	++_generation;
+	_wakeCondition.notify_all();
+	_doneCondition.wait(lock, [this] { return _remaining == 0; });
+	_task = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t workerIndex)
+{
+	size_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			_wakeCondition.wait(lock, [&] { return _stop || _generation != seenGeneration; });
+			if (_stop)
+				return;
+			seenGeneration = _generation;
+		}
+
+		size_t taskIndex;
+		while (popTask(workerIndex, taskIndex) || stealTask(workerIndex, taskIndex))
+		{
+			(*_task)(taskIndex);
+
+			// The last task to finish wakes up parallelFor
+			if (_remaining.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+				_doneCondition.notify_all();
+			}
+		}
+	}
+}
+
+bool ThreadPool::popTask(size_t workerIndex, size_t& taskIndex)
+{
+	WorkQueue& queue = _queues[workerIndex];
+	std::lock_guard<std::mutex> lock{ queue._mutex };
+	if (queue._tasks.empty())
+		return false;
+
+	taskIndex = queue._tasks.back();
+	queue._tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::stealTask(size_t workerIndex, size_t& taskIndex)
+{
+	const size_t numQueues = _queues.size();
+	for (size_t offset = 1; offset < numQueues; ++offset)
+	{
+		WorkQueue& victim = _queues[(workerIndex + offset) % numQueues];
+		std::lock_guard<std::mutex> lock{ victim._mutex };
+		if (victim._tasks.empty())
+			continue;
+
+		taskIndex = victim._tasks.front();
+		victim._tasks.pop_front();
+		return true;
+	}
+	return false;
+}
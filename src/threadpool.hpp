@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+// A fixed set of worker threads that live for as long as the pool does.
+// Work is handed out as task indices which are spread over one deque per
+// worker. A worker takes tasks from the back of its own deque and steals
+// from the front of the others when it runs dry, so an expensive task
+// never leaves the remaining workers idle.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t numThreads);
+	ThreadPool(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	// Calls task(i) once for every i in [0, numTasks) and blocks until all calls are done
+	void parallelFor(size_t numTasks, const std::function<void(size_t)>& task);
+	size_t size() const { return _workers.size(); }
+
+	// Number of usable hardware threads, at least 1
+	static size_t hardwareThreads();
+
+private:
+	struct WorkQueue
+	{
+		std::mutex _mutex;
+		std::deque<size_t> _tasks;
+	};
+
+	std::vector<std::thread> _workers;
+	std::vector<WorkQueue> _queues;
+
+	std::mutex _mutex;
+	std::condition_variable _wakeCondition;
+	std::condition_variable _doneCondition;
+	size_t _generation = 0;
+	bool _stop = false;
+
+	const std::function<void(size_t)>* _task = nullptr;
+	std::atomic<size_t> _remaining{ 0 };
+
+	void workerLoop(size_t workerIndex);
+	bool popTask(size_t workerIndex, size_t& taskIndex);
+	bool stealTask(size_t workerIndex, size_t& taskIndex);
+};
@@ -0,0 +1,64 @@
+#include "tile.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	// Spreads the 16 bits of v out to the even bits of the result
+	uint32_t spreadBits(uint32_t v)
+	{
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+}
+
+Tile Tile::clampedTo(int width, int height) const
+{
+	Tile clamped;
+	clamped.x0 = std::clamp(x0, 0, width);
+	clamped.y0 = std::clamp(y0, 0, height);
+	clamped.x1 = std::clamp(x1, clamped.x0, width);
+	clamped.y1 = std::clamp(y1, clamped.y0, height);
+	return clamped;
+}
+
+uint32_t mortonCode(uint16_t x, uint16_t y)
+{
+	return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+std::vector<Tile> mortonOrderedTiles(int width, int height, int tileSize)
+{
+	tileSize = std::max(tileSize, 1);
+	const int tilesX = (width + tileSize - 1) / tileSize;
+	const int tilesY = (height + tileSize - 1) / tileSize;
+
+	std::vector<std::pair<uint32_t, Tile>> codedTiles;
+	codedTiles.reserve(static_cast<size_t>(tilesX) * tilesY);
+
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			Tile tile{
+				tx * tileSize, ty * tileSize,
+				std::min((tx + 1) * tileSize, width), std::min((ty + 1) * tileSize, height) };
+			codedTiles.emplace_back(mortonCode(static_cast<uint16_t>(tx), static_cast<uint16_t>(ty)), tile);
+		}
+	}
+
+	// The tile grid is rarely a power of two so the curve is not complete,
+	// sorting by code still keeps the Z-order of the tiles that do exist
+	std::sort(codedTiles.begin(), codedTiles.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	std::vector<Tile> tiles;
+	tiles.reserve(codedTiles.size());
+	for (const auto& codedTile : codedTiles)
+		tiles.push_back(codedTile.second);
+
+	return tiles;
+}
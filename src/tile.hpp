@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// A rectangular block of pixels, [x0, x1) x [y0, y1)
+struct Tile
+{
+	int x0, y0;
+	int x1, y1;
+
+	int width() const { return x1 - x0; }
+	int height() const { return y1 - y0; }
+	int area() const { return width() * height(); }
+	// The part inside a width x height image, empty rather than inverted if nothing is
+	Tile clampedTo(int width, int height) const;
+};
+
+// Interleaves the bits of x and y, neighbouring tiles get nearby codes
+uint32_t mortonCode(uint16_t x, uint16_t y);
+
+// Splits a width x height image into tiles of at most tileSize x tileSize pixels,
+// ordered along a Morton (Z-order) curve so consecutive tiles are spatially close
+std::vector<Tile> mortonOrderedTiles(int width, int height, int tileSize);
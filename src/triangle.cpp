@@ -33,7 +33,7 @@ float Triangle::rayIntersection(const Ray& arg) const
 	glm::vec3 T = arg.getStart() - _v1;
 	glm::vec3 E1 = _v2 - _v1;
 	glm::vec3 E2 = _v3 - _v1;
-	glm::vec3 D = arg.getEnd() - arg.getStart();
+	glm::vec3 D = arg._direction;
 	glm::vec3 P = glm::cross(glm::vec3(D), glm::vec3(E2));
 	glm::vec3 Q = glm::cross(glm::vec3(T), glm::vec3(E1));
 
@@ -45,6 +45,7 @@ float Triangle::rayIntersection(const Ray& arg) const
 
 	bool pointIsOnTriangle = (u >= 0) && (v >= 0) && (u + v <= 1);
 
-	// Return t for the intersection or -1 if no intersection is found
-	return (pointIsOnTriangle && t > 0) ? t * glm::length(D) : -1;
+	// Return t for the intersection or -1 if no intersection is found beyond the
+	// ray's tMin, the direction is normalized so t is the distance along the ray
+	return (pointIsOnTriangle && t > arg._tMin) ? t : -1;
 }
\ No newline at end of file
@@ -12,6 +12,8 @@ public:
 	Direction getNormal() const { return _normal; }
 	Vertex getCenter() const;
 	Vertex getPoint() const { return _v1; };
+	// The corners in the order they were given, i is 0, 1 or 2
+	Vertex getVertex(int i) const { return i == 0 ? _v1 : (i == 1 ? _v2 : _v3); }
 	float rayIntersection(const Ray& arg) const;
 private:
 	Vertex _v1, _v2, _v3;
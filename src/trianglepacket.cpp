@@ -0,0 +1,225 @@
+#include "trianglepacket.hpp"
+
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define HAS_SSE_TRIANGLE_KERNEL
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(HAS_AVX2_TRIANGLE_KERNEL)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// The arithmetic of Triangle::rayIntersection in the same order, so the distances
+	// come out identical. Dot products are summed x, y, then z like glm does
+	uint32_t intersectScalar(const Ray& ray, const TrianglePacket& packet, float tMax, float* t)
+	{
+		const glm::vec3& d = ray._direction;
+		uint32_t hits = 0;
+		for (int i = 0; i < TrianglePacket::WIDTH; ++i)
+		{
+			const float tx = ray._origin.x - packet._v0x[i];
+			const float ty = ray._origin.y - packet._v0y[i];
+			const float tz = ray._origin.z - packet._v0z[i];
+			const float e1x = packet._e1x[i], e1y = packet._e1y[i], e1z = packet._e1z[i];
+			const float e2x = packet._e2x[i], e2y = packet._e2y[i], e2z = packet._e2z[i];
+
+			const float px = d.y * e2z - e2y * d.z;
+			const float py = d.z * e2x - e2z * d.x;
+			const float pz = d.x * e2y - e2x * d.y;
+			const float qx = ty * e1z - e1y * tz;
+			const float qy = tz * e1x - e1z * tx;
+			const float qz = tx * e1y - e1x * ty;
+
+			const float factor = 1.0f / (px * e1x + py * e1y + pz * e1z);
+			const float distance = factor * (qx * e2x + qy * e2y + qz * e2z);
+			const float u = factor * (px * tx + py * ty + pz * tz);
+			const float v = factor * (qx * d.x + qy * d.y + qz * d.z);
+
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance > ray._tMin && distance <= tMax)
+			{
+				t[i] = distance;
+				hits |= 1u << i;
+			}
+		}
+		return hits;
+	}
+
+#ifdef HAS_SSE_TRIANGLE_KERNEL
+	// Four triangles starting at first
+	uint32_t intersectSseHalf(const Ray& ray, const TrianglePacket& packet, int first, __m128 tMin, __m128 tMax, float* t)
+	{
+		const __m128 dx = _mm_set1_ps(ray._direction.x);
+		const __m128 dy = _mm_set1_ps(ray._direction.y);
+		const __m128 dz = _mm_set1_ps(ray._direction.z);
+		const __m128 tx = _mm_sub_ps(_mm_set1_ps(ray._origin.x), _mm_load_ps(&packet._v0x[first]));
+		const __m128 ty = _mm_sub_ps(_mm_set1_ps(ray._origin.y), _mm_load_ps(&packet._v0y[first]));
+		const __m128 tz = _mm_sub_ps(_mm_set1_ps(ray._origin.z), _mm_load_ps(&packet._v0z[first]));
+		const __m128 e1x = _mm_load_ps(&packet._e1x[first]);
+		const __m128 e1y = _mm_load_ps(&packet._e1y[first]);
+		const __m128 e1z = _mm_load_ps(&packet._e1z[first]);
+		const __m128 e2x = _mm_load_ps(&packet._e2x[first]);
+		const __m128 e2y = _mm_load_ps(&packet._e2y[first]);
+		const __m128 e2z = _mm_load_ps(&packet._e2z[first]);
+
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(e1y, tz));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(e1z, tx));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(e1x, ty));
+
+		auto dot = [](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+		};
+
+		const __m128 factor = _mm_div_ps(_mm_set1_ps(1.0f), dot(px, py, pz, e1x, e1y, e1z));
+		const __m128 distance = _mm_mul_ps(factor, dot(qx, qy, qz, e2x, e2y, e2z));
+		const __m128 u = _mm_mul_ps(factor, dot(px, py, pz, tx, ty, tz));
+		const __m128 v = _mm_mul_ps(factor, dot(qx, qy, qz, dx, dy, dz));
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 hit = _mm_and_ps(
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+				_mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f))),
+			_mm_and_ps(_mm_cmpgt_ps(distance, tMin), _mm_cmple_ps(distance, tMax)));
+
+		_mm_storeu_ps(&t[first], distance);
+		return static_cast<uint32_t>(_mm_movemask_ps(hit)) << first;
+	}
+
+	uint32_t intersectSse(const Ray& ray, const TrianglePacket& packet, float tMax, float* t)
+	{
+		const __m128 start = _mm_set1_ps(ray._tMin);
+		const __m128 limit = _mm_set1_ps(tMax);
+		return intersectSseHalf(ray, packet, 0, start, limit, t) | intersectSseHalf(ray, packet, 4, start, limit, t);
+	}
+#endif
+
+#ifdef HAS_AVX2_TRIANGLE_KERNEL
+	bool cpuHasAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// AVX needs the OS to save the wide registers on a context switch
+		__cpuid(info, 1);
+		const bool osSavesRegisters = (info[2] & (1 << 27)) != 0;
+		const bool hasAvx = (info[2] & (1 << 28)) != 0;
+		if (!osSavesRegisters || !hasAvx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+TrianglePacket::TrianglePacket()
+{
+	// NaN corners fail every comparison in the kernels
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for (int i = 0; i < WIDTH; ++i)
+	{
+		_v0x[i] = _v0y[i] = _v0z[i] = nan;
+		_e1x[i] = _e1y[i] = _e1z[i] = nan;
+		_e2x[i] = _e2y[i] = _e2z[i] = nan;
+		_primitive[i] = 0;
+	}
+	_castsShadow = 0;
+}
+
+void TrianglePacket::set(int lane, const Triangle& triangle, uint32_t primitive, bool castsShadow)
+{
+	const Vertex v0 = triangle.getVertex(0);
+	const glm::vec3 e1 = triangle.getVertex(1) - v0;
+	const glm::vec3 e2 = triangle.getVertex(2) - v0;
+
+	_v0x[lane] = v0.x;
+	_v0y[lane] = v0.y;
+	_v0z[lane] = v0.z;
+	_e1x[lane] = e1.x;
+	_e1y[lane] = e1.y;
+	_e1z[lane] = e1.z;
+	_e2x[lane] = e2.x;
+	_e2y[lane] = e2.y;
+	_e2z[lane] = e2.z;
+	_primitive[lane] = primitive;
+	if (castsShadow)
+		_castsShadow |= 1u << lane;
+}
+
+TriangleKernel detectTriangleKernel()
+{
+	if (triangleKernelSupported(TriangleKernel::AVX2))
+		return TriangleKernel::AVX2;
+	if (triangleKernelSupported(TriangleKernel::SSE))
+		return TriangleKernel::SSE;
+	return TriangleKernel::SCALAR;
+}
+
+bool triangleKernelSupported(TriangleKernel kernel)
+{
+	switch (kernel)
+	{
+	case TriangleKernel::SCALAR:
+		return true;
+	case TriangleKernel::SSE:
+#ifdef HAS_SSE_TRIANGLE_KERNEL
+		return true;
+#else
+		return false;
+#endif
+	case TriangleKernel::AVX2:
+#ifdef HAS_AVX2_TRIANGLE_KERNEL
+		static const bool hasAvx2 = cpuHasAvx2();
+		return hasAvx2;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+TrianglePacketTest trianglePacketTest(TriangleKernel kernel)
+{
+	switch (kernel)
+	{
+	case TriangleKernel::SCALAR:
+		break;
+	case TriangleKernel::SSE:
+#ifdef HAS_SSE_TRIANGLE_KERNEL
+		return &intersectSse;
+#else
+		break;
+#endif
+	case TriangleKernel::AVX2:
+#ifdef HAS_AVX2_TRIANGLE_KERNEL
+		return &intersectTrianglePacketAvx2;
+#else
+		break;
+#endif
+	}
+	return &intersectScalar;
+}
+
+const char* triangleKernelName(TriangleKernel kernel)
+{
+	switch (kernel)
+	{
+	case TriangleKernel::SCALAR: return "scalar";
+	case TriangleKernel::SSE: return "SSE";
+	case TriangleKernel::AVX2: return "AVX2";
+	}
+	return "unknown";
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ray.hpp"
+#include "triangle.hpp"
+
+// Eight triangles as structure of arrays, so a ray can be tested against all of them
+// at once. Each one is stored as a corner and the two edges from it, worked out once
+// instead of for every ray. Lanes that were never set are never hit
+struct alignas(32) TrianglePacket
+{
+	static constexpr int WIDTH = 8;
+
+	TrianglePacket();
+	void set(int lane, const Triangle& triangle, uint32_t primitive, bool castsShadow);
+
+	float _v0x[WIDTH], _v0y[WIDTH], _v0z[WIDTH];
+	float _e1x[WIDTH], _e1y[WIDTH], _e1z[WIDTH];
+	float _e2x[WIDTH], _e2y[WIDTH], _e2z[WIDTH];
+	// The BVH primitive each triangle belongs to
+	uint32_t _primitive[WIDTH];
+	// Bit i is set if triangle i blocks shadow rays
+	uint32_t _castsShadow;
+};
+
+enum class TriangleKernel
+{
+	SCALAR,
+	SSE,
+	AVX2
+};
+
+// Tests ray against all triangles of packet the same way Triangle::rayIntersection
+// does, bit for bit as both are built without contracted multiply-adds. Returns a bit
+// for every triangle hit no further away than tMax and writes the distances of those to t
+using TrianglePacketTest = uint32_t (*)(const Ray& ray, const TrianglePacket& packet, float tMax, float* t);
+
+// The widest kernel the CPU runs
+TriangleKernel detectTriangleKernel();
+bool triangleKernelSupported(TriangleKernel kernel);
+TrianglePacketTest trianglePacketTest(TriangleKernel kernel);
+const char* triangleKernelName(TriangleKernel kernel);
+
+#ifdef HAS_AVX2_TRIANGLE_KERNEL
+// In trianglepacket_avx2.cpp, the only file built for AVX2
+uint32_t intersectTrianglePacketAvx2(const Ray& ray, const TrianglePacket& packet, float tMax, float* t);
+#endif
@@ -0,0 +1,54 @@
+#include "trianglepacket.hpp"
+
+// Built with AVX2 enabled, nothing in here may run before the CPU was checked for it
+#ifdef HAS_AVX2_TRIANGLE_KERNEL
+
+#include <immintrin.h>
+
+namespace
+{
+	__m256 dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+	}
+}
+
+// The SSE kernel with all eight triangles at once
+uint32_t intersectTrianglePacketAvx2(const Ray& ray, const TrianglePacket& packet, float tMax, float* t)
+{
+	const __m256 dx = _mm256_set1_ps(ray._direction.x);
+	const __m256 dy = _mm256_set1_ps(ray._direction.y);
+	const __m256 dz = _mm256_set1_ps(ray._direction.z);
+	const __m256 tx = _mm256_sub_ps(_mm256_set1_ps(ray._origin.x), _mm256_load_ps(packet._v0x));
+	const __m256 ty = _mm256_sub_ps(_mm256_set1_ps(ray._origin.y), _mm256_load_ps(packet._v0y));
+	const __m256 tz = _mm256_sub_ps(_mm256_set1_ps(ray._origin.z), _mm256_load_ps(packet._v0z));
+	const __m256 e1x = _mm256_load_ps(packet._e1x);
+	const __m256 e1y = _mm256_load_ps(packet._e1y);
+	const __m256 e1z = _mm256_load_ps(packet._e1z);
+	const __m256 e2x = _mm256_load_ps(packet._e2x);
+	const __m256 e2y = _mm256_load_ps(packet._e2y);
+	const __m256 e2z = _mm256_load_ps(packet._e2z);
+
+	const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+	const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+	const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+	const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(e1y, tz));
+	const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(e1z, tx));
+	const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(e1x, ty));
+
+	const __m256 factor = _mm256_div_ps(_mm256_set1_ps(1.0f), dot(px, py, pz, e1x, e1y, e1z));
+	const __m256 distance = _mm256_mul_ps(factor, dot(qx, qy, qz, e2x, e2y, e2z));
+	const __m256 u = _mm256_mul_ps(factor, dot(px, py, pz, tx, ty, tz));
+	const __m256 v = _mm256_mul_ps(factor, dot(qx, qy, qz, dx, dy, dz));
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 hit = _mm256_and_ps(
+		_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+			_mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ)),
+		_mm256_and_ps(_mm256_cmp_ps(distance, _mm256_set1_ps(ray._tMin), _CMP_GT_OQ), _mm256_cmp_ps(distance, _mm256_set1_ps(tMax), _CMP_LE_OQ)));
+
+	_mm256_storeu_ps(t, distance);
+	return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+}
+
+#endif
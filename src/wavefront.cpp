@@ -0,0 +1,325 @@
+#include "wavefront.hpp"
+
+#include "scene.hpp"
+#include "raycastingfunctions.hpp"
+#include "arena.hpp"
+#include "packet.hpp"
+#include "diagnostics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace
+{
+	// Spreads the 10 bits of v out to every third bit of the result
+	uint32_t spreadBits3(uint32_t v)
+	{
+		v &= 0x3FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	// Quantizes x in [low, high] to 9 bits
+	uint32_t quantize(float x, float low, float high)
+	{
+		const float scaled = (x - low) / std::max(high - low, 1e-6f) * 511.0f;
+		return static_cast<uint32_t>(std::clamp(scaled, 0.0f, 511.0f));
+	}
+}
+
+size_t WavefrontIntegrator::addPath(const Ray& ray, const RandomStream& random)
+{
+	const uint32_t slot = static_cast<uint32_t>(_radiance.size());
+	_radiance.emplace_back(0.0);
+	_raysTraced.push_back(0);
+	_current.push(ray, Color{ 1.0 }, PathDepth{}, random, slot, 0);
+	return slot;
+}
+
+void WavefrontIntegrator::clear()
+{
+	_current.clear();
+	_next.clear();
+	_shadowRays.clear();
+	_radiance.clear();
+	_raysTraced.clear();
+	_raysExtended = 0;
+	_extendSeconds = 0.0;
+}
+
+template<typename Settings>
+void WavefrontIntegrator::trace(Scene& scene)
+{
+	bool firstBounce = true;
+	while (_current.size() > 0)
+	{
+		const auto extendStart = std::chrono::high_resolution_clock::now();
+		// The camera rays are already in pixel order, which is as coherent as it gets
+		if (!firstBounce && Config::sortSecondaryRays())
+			sortSecondaryRays();
+		extend(scene);
+		_raysExtended += _current.size();
+		_extendSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - extendStart).count();
+		firstBounce = false;
+
+		sortBySurface();
+
+		_next.clear();
+		_shadowRays.clear();
+		shade<Settings>(scene);
+		traceShadowRays(scene);
+
+		// The paths that went on are already compacted into _next
+		std::swap(_current, _next);
+	}
+
+	_statistics._samples += _radiance.size();
+	scene._terminationPolicy.record(_statistics);
+	_statistics = PathStatistics{};
+}
+
+void WavefrontIntegrator::sortSecondaryRays()
+{
+	const size_t numPaths = _current.size();
+	if (numPaths < 2)
+		return;
+
+	glm::vec3 low{ std::numeric_limits<float>::max() };
+	glm::vec3 high{ std::numeric_limits<float>::lowest() };
+	for (const Ray& ray : _current._rays)
+	{
+		low = glm::min(low, ray._origin);
+		high = glm::max(high, ray._origin);
+	}
+
+	// 3 bits of octant above 27 bits of Morton code
+	_sortKeys.resize(numPaths);
+	for (size_t i = 0; i < numPaths; ++i)
+	{
+		const Ray& ray = _current._rays[i];
+		const uint64_t octant =
+			(ray._direction.x < 0.0f ? 4u : 0u) | (ray._direction.y < 0.0f ? 2u : 0u) | (ray._direction.z < 0.0f ? 1u : 0u);
+		const uint64_t morton =
+			spreadBits3(quantize(ray._origin.x, low.x, high.x)) |
+			(spreadBits3(quantize(ray._origin.y, low.y, high.y)) << 1) |
+			(spreadBits3(quantize(ray._origin.z, low.z, high.z)) << 2);
+		_sortKeys[i] = (((octant << 27) | morton) << 32) | i;
+	}
+	std::sort(_sortKeys.begin(), _sortKeys.end());
+
+	// Gathered into the next queue, it is free until shading starts
+	_next.clear();
+	for (uint64_t key : _sortKeys)
+	{
+		const uint32_t i = static_cast<uint32_t>(key);
+		_next.push(_current._rays[i], _current._throughput[i], _current._depth[i], _current._random[i],
+			_current._slot[i], _current._flags[i]);
+	}
+	std::swap(_current, _next);
+}
+
+void WavefrontIntegrator::extend(Scene& scene)
+{
+	const size_t numPaths = _current.size();
+	_hits.resize(numPaths);
+
+	// Paths next to each other in the queue make up the packets. On the first bounce they
+	// are camera rays of neighbouring pixels, after that they have diverged and
+	// PacketGeometry traces them one by one
+	const size_t packetSize = Config::packetSize();
+	for (size_t first = 0; first < numPaths; first += packetSize)
+	{
+		const size_t count = std::min(packetSize, numPaths - first);
+		std::array<bool, MAX_PACKET_SIZE> alive;
+		bool allAlive = true;
+		for (size_t i = 0; i < count; ++i)
+		{
+			_current._random[first + i].nextBounce();
+			alive[i] = _raysTraced[_current._slot[first + i]]++ < _maxPathRays;
+			allAlive = allAlive && alive[i];
+			if (alive[i])
+				++_statistics._rays;
+			else
+			{
+				++_statistics._endedByCap;
+				// Counted once per sample, for the first of its paths over the cap
+				if (_raysTraced[_current._slot[first + i]] == _maxPathRays + 1)
+					Diagnostics::count(Diagnostic::PATH_RAY_CAP);
+			}
+			_hits[first + i].reset();
+		}
+
+		if (count > 1 && allAlive)
+		{
+			scene._packetGeometry.intersect(&_current._rays[first], count, &_hits[first]);
+		}
+		else
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (alive[i])
+					_hits[first + i] = rayIntersection(_current._rays[first + i], scene._sceneGeometry);
+			}
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (alive[i] && !_hits[first + i])
+			{
+				Diagnostics::count(Diagnostic::ESCAPED_RAY);
+				++_statistics._endedNaturally;
+			}
+		}
+	}
+}
+
+void WavefrontIntegrator::sortBySurface()
+{
+	for (auto& paths : _pathsBySurface)
+		paths.clear();
+
+	for (size_t i = 0; i < _hits.size(); ++i)
+	{
+		if (_hits[i])
+			_pathsBySurface[_hits[i]->intersectionObject->getBRDF().getSurfaceType()].push_back(static_cast<uint32_t>(i));
+	}
+}
+
+template<typename Settings>
+void WavefrontIntegrator::shade(Scene& scene)
+{
+	// Lights end the path, seen through specular surfaces they are counted here
+	// and after a diffuse bounce the shadow rays already took care of them
+	_statistics._endedNaturally += _pathsBySurface[BRDF::LIGHT].size();
+	for (uint32_t path : _pathsBySurface[BRDF::LIGHT])
+	{
+		if (_current._flags[path] & DIFFUSELY_REFLECTED)
+			shadeLocalLight<Settings>(path, *_hits[path], scene);
+		else
+			_radiance[_current._slot[path]] += _current._throughput[path] * LIGHT_RADIANCE;
+	}
+
+	for (unsigned surfaceType : { BRDF::DIFFUSE, BRDF::REFLECTOR, BRDF::TRANSPARENT })
+	{
+		for (uint32_t path : _pathsBySurface[surfaceType])
+		{
+			const IntersectionSurface& hit = *_hits[path];
+			if (surfaceType != BRDF::TRANSPARENT)
+				shadeLocalLight<Settings>(path, hit, scene);
+
+			const uint8_t flags = _current._flags[path];
+			std::array<Continuation, 2> continuations;
+			const PathDepth depth = _current._depth[path].after(surfaceType);
+			size_t numContinuations = scatter<Settings>(
+				_current._rays[path], flags & REFLECTED, hit, scene, _current._random[path], continuations);
+			numContinuations = applyTermination(scene._terminationPolicy, depth, surfaceType, _current._throughput[path],
+				_current._random[path], continuations, numContinuations, _statistics);
+
+			for (size_t c = 0; c < numContinuations; ++c)
+			{
+				const Continuation& continuation = continuations[c];
+				uint8_t nextFlags = flags & DIFFUSELY_REFLECTED;
+				if (continuation._isDiffuse)
+					nextFlags |= DIFFUSELY_REFLECTED;
+				if (continuation._isReflected)
+					nextFlags |= REFLECTED;
+
+				// The second branch of a split needs random numbers of its own
+				_next.push(
+					continuation._ray,
+					_current._throughput[path] * continuation._weight,
+					depth,
+					c == 0 ? _current._random[path] : _current._random[path].branch(),
+					_current._slot[path],
+					nextFlags);
+			}
+		}
+	}
+}
+
+template<typename Settings>
+void WavefrontIntegrator::shadeLocalLight(uint32_t path, const IntersectionSurface& hit, Scene& scene)
+{
+	const IntersectionData& intersection = hit.intersectionData;
+	const Ray& ray = _current._rays[path];
+	const Color& throughput = _current._throughput[path];
+
+	if (Settings::usePhotonMapping && !scene._photonMap->areShadowPhotonsPresent(intersection._intersectPoint))
+	{
+		// The gathered photons only live for this one lookup
+		ScratchArena::local().reset();
+		_radiance[_current._slot[path]] += throughput * scene._photonMap->getPhotonRadianceContrib(
+			-ray.getNormalizedDirection(), hit.intersectionObject, intersection);
+		return;
+	}
+
+	// TODO Adapt for varying amout of lights
+	const auto& light = scene._sceneGeometry._ceilingLights[0];
+	RandomStream& random = _current._random[path];
+
+	const int numShadowRays = Settings::numShadowRays();
+	for (int i = 0; i < numShadowRays; ++i)
+	{
+		float rand1 = random.next();
+		float rand2 = random.next();
+
+		Ray shadowRay;
+		const Color contribution = throughput * sampleAreaLight(
+			ray, intersection._intersectPoint, intersection._normal, hit.intersectionObject,
+			light, rand1, rand2, numShadowRays, shadowRay);
+
+		// Facing away from the light, no need to test this one
+		if (contribution == Color{ 0.0 })
+			continue;
+
+		_shadowRays._rays.push_back(shadowRay);
+		_shadowRays._contribution.push_back(contribution);
+		_shadowRays._slot.push_back(_current._slot[path]);
+	}
+}
+
+void WavefrontIntegrator::traceShadowRays(Scene& scene)
+{
+	for (size_t i = 0; i < _shadowRays.size(); ++i)
+	{
+		if (pathIsVisible(_shadowRays._rays[i], scene._sceneGeometry))
+			_radiance[_shadowRays._slot[i]] += _shadowRays._contribution[i];
+	}
+}
+
+void WavefrontIntegrator::PathQueue::clear()
+{
+	_rays.clear();
+	_throughput.clear();
+	_depth.clear();
+	_random.clear();
+	_slot.clear();
+	_flags.clear();
+}
+
+void WavefrontIntegrator::PathQueue::push(const Ray& ray, const Color& throughput, const PathDepth& depth,
+	const RandomStream& random, uint32_t slot, uint8_t flags)
+{
+	_rays.push_back(ray);
+	_throughput.push_back(throughput);
+	_depth.push_back(depth);
+	_random.push_back(random);
+	_slot.push_back(slot);
+	_flags.push_back(flags);
+}
+
+void WavefrontIntegrator::ShadowQueue::clear()
+{
+	_rays.clear();
+	_contribution.clear();
+	_slot.clear();
+}
+
+#define INSTANTIATE_WAVEFRONT_KERNEL(photonMapping, shadowRays) \
+	template void WavefrontIntegrator::trace<KernelSettings<photonMapping, shadowRays>>(Scene&);
+FOR_EACH_KERNEL_SETTINGS(INSTANTIATE_WAVEFRONT_KERNEL)
+#undef INSTANTIATE_WAVEFRONT_KERNEL
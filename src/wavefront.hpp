@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include "basic_types.hpp"
+#include "ray.hpp"
+#include "random.hpp"
+#include "shapes.hpp"
+#include "termination.hpp"
+
+class Scene;
+
+// Traces a whole batch of camera paths one stage at a time instead of one path
+// after the other. Every bounce runs the same stages over all paths that are
+// still alive:
+//   sort    orders the secondary rays by direction and origin (optional)
+//   extend  finds the closest hit of every path
+//   sort    groups the paths by the surface type they hit
+//   shade   adds emission, queues the shadow rays and decides how each path goes on
+//   shadow  tests all queued shadow rays at once
+// The paths that go on are written compacted to the next queue. The estimator is
+// the same as the one of PathTracer, glass splits become two paths in the queue.
+class WavefrontIntegrator
+{
+public:
+	// Adds a path starting at ray, returns the slot its radiance ends up in
+	size_t addPath(const Ray& ray, const RandomStream& random);
+	// Settings is the KernelSettings instantiation matching the config
+	template<typename Settings>
+	void trace(Scene& scene);
+	// The radiance of every path added since the last clear, by slot
+	const std::vector<Color>& radiance() const { return _radiance; }
+	void clear();
+
+	// The rays the extend stage traced since the last clear and the time it took,
+	// including the sorting of the secondary rays
+	uint64_t raysExtended() const { return _raysExtended; }
+	double extendSeconds() const { return _extendSeconds; }
+
+private:
+	enum PathFlags : uint8_t
+	{
+		DIFFUSELY_REFLECTED = 1,
+		REFLECTED = 2
+	};
+
+	// Structure of arrays, entry i of every vector belongs to the same path
+	struct PathQueue
+	{
+		std::vector<Ray> _rays;
+		std::vector<Color> _throughput;
+		std::vector<PathDepth> _depth;
+		std::vector<RandomStream> _random;
+		std::vector<uint32_t> _slot;
+		std::vector<uint8_t> _flags;
+
+		size_t size() const { return _rays.size(); }
+		void clear();
+		void push(const Ray& ray, const Color& throughput, const PathDepth& depth, const RandomStream& random,
+			uint32_t slot, uint8_t flags);
+	};
+
+	struct ShadowQueue
+	{
+		std::vector<Ray> _rays;
+		// Added to the slot's radiance if the ray reaches the light
+		std::vector<Color> _contribution;
+		std::vector<uint32_t> _slot;
+
+		size_t size() const { return _rays.size(); }
+		void clear();
+	};
+
+	PathQueue _current;
+	PathQueue _next;
+	ShadowQueue _shadowRays;
+
+	// Closest hits of the paths in _current
+	std::vector<std::optional<IntersectionSurface>> _hits;
+	// Indices into _current grouped by BRDF surface type
+	std::array<std::vector<uint32_t>, 4> _pathsBySurface;
+
+	std::vector<Color> _radiance;
+	std::vector<uint32_t> _raysTraced;
+
+	// Sort key with the path index in the low 32 bits
+	std::vector<uint64_t> _sortKeys;
+
+	uint64_t _raysExtended = 0;
+	double _extendSeconds = 0.0;
+	// Handed to the termination policy at the end of each trace
+	PathStatistics _statistics;
+
+	// The same cap as a single path has
+	static constexpr uint32_t _maxPathRays = 512;
+
+	// After the first bounce the rays point every which way, sorting them by direction
+	// octant and then by the Morton code of their origin lets rays that are traced one
+	// after the other visit the same geometry
+	void sortSecondaryRays();
+	void extend(Scene& scene);
+	void sortBySurface();
+	template<typename Settings>
+	void shade(Scene& scene);
+	template<typename Settings>
+	void shadeLocalLight(uint32_t path, const IntersectionSurface& hit, Scene& scene);
+	void traceShadowRays(Scene& scene);
+};